@@ -0,0 +1,468 @@
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <complex>
+#include <ranges>
+
+#include <CL/sycl.hpp>
+
+#include "rendering.hh"
+#include "metrics.hh"
+
+// Headless frame-time benchmark. Renders seeded synthetic scenes into an
+// ordinary host buffer for every combination of vertex count, resolution,
+// device selector, banding and vertex format, and prints one JSON object per
+// combination on stdout.
+//
+// Built as graphio-bench with graphio's own flags, for the timings, and as
+// graphio-bench-check with GRAPHIO_BENCH_CHECK and a precise floating-point
+// model, for the checks: the density of each frame is compared with a serial
+// reference, exactly, and with fp64's within the bound of reference_slack(),
+// and with --expect its checksum with the table of golden checksums, keyed
+// by format, size, vertex and segment count; the exit status reports any
+// mismatch.
+
+#ifndef GRAPHIO_BENCH_CHECK
+#define GRAPHIO_BENCH_CHECK 0
+#endif
+
+inline namespace benchmark_helper
+{
+    constexpr bool checking = GRAPHIO_BENCH_CHECK;
+
+    struct options {
+        std::vector<size_t> vertices{1'000, 10'000, 100'000, 1'000'000, 10'000'000, 50'000'000};
+        std::vector<size_t> segments{0};
+        std::vector<sycl::range<2>> sizes{{768, 1024}, {1080, 1920}, {2160, 3840}};
+        std::vector<std::string> devices{"default"};
+        std::vector<std::string> formats{fp64::name, fp32::name, fixed16::name};
+        std::vector<std::string> bands{"0"};
+        size_t frames = 20;
+        std::string expect;
+    };
+
+    // "<format> <width>x<height> <vertices> <segments>", as in the table.
+    auto configuration(std::string_view format, sycl::range<2> dim, size_t vertices, size_t segments) {
+        std::ostringstream ret;
+        ret << format << ' ' << dim[1] << 'x' << dim[0] << ' ' << vertices << ' ' << segments;
+        return ret.str();
+    }
+
+    // One configuration and its checksum per line; '#' starts a comment.
+    [[nodiscard]] bool load_expectations(std::string const& path, std::map<std::string, uint64_t>& table) noexcept {
+        std::ifstream input(path);
+        if (!input) {
+            std::cerr << "open " << path << " failed..." << std::endl;
+            return false;
+        }
+        for (std::string line; std::getline(input, line);) {
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string format, size;
+            size_t vertices, segments;
+            uint64_t sum;
+            if (!(fields >> format)) continue;
+            if (!(fields >> size >> vertices >> segments >> std::hex >> sum)) {
+                std::cerr << "parse " << path << " failed: " << line << std::endl;
+                return false;
+            }
+            table[format + ' ' + size + ' ' + std::to_string(vertices) + ' ' + std::to_string(segments)] = sum;
+        }
+        return true;
+    }
+
+    auto split(std::string_view list) {
+        std::vector<std::string> ret;
+        for (auto item : list | std::views::split(',')) {
+            ret.emplace_back(item.begin(), item.end());
+        }
+        return ret;
+    }
+
+    [[nodiscard]] bool parse(int argc, char** argv, options& opts) noexcept {
+        try {
+            for (int i = 1; i + 1 < argc; i += 2) {
+                std::string_view key = argv[i];
+                std::string_view value = argv[i + 1];
+                if (key == "--vertices") {
+                    opts.vertices.clear();
+                    for (auto const& item : split(value)) opts.vertices.push_back(static_cast<size_t>(std::stod(item)));
+                }
+                else if (key == "--segments") {
+                    opts.segments.clear();
+                    for (auto const& item : split(value)) opts.segments.push_back(static_cast<size_t>(std::stod(item)));
+                }
+                else if (key == "--sizes") {
+                    opts.sizes.clear();
+                    for (auto const& item : split(value)) {
+                        auto x = item.find('x');
+                        opts.sizes.push_back({std::stoul(item.substr(x + 1)), std::stoul(item.substr(0, x))});
+                    }
+                }
+                else if (key == "--devices") {
+                    opts.devices = split(value);
+                }
+                else if (key == "--formats") {
+                    opts.formats = split(value);
+                }
+                else if (key == "--bands") {
+                    opts.bands = split(value);
+                }
+                else if (key == "--expect" && checking) {
+                    opts.expect = value;
+                }
+                else if (key == "--frames") {
+                    opts.frames = std::max(1ul, std::stoul(std::string(value)));
+                }
+                else {
+                    return false;
+                }
+            }
+            return argc % 2 == 1;
+        }
+        catch (std::exception&) {
+            return false;
+        }
+    }
+
+    // splitmix64, so that scenes (and so checksums) do not depend on the standard library.
+    inline uint64_t next_random(uint64_t& state) noexcept {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    auto make_scene(size_t count, sycl::range<2> dim) {
+        std::vector<std::complex<double>> vertices;
+        vertices.reserve(count + 1);
+        vertices.emplace_back(dim[1] / 2, dim[0] / 2);
+        uint64_t state = count;
+        auto uniform = [&](double scale) noexcept {
+            return (next_random(state) >> 11) * 0x1.0p-53 * scale;
+        };
+        // x before y; the order arguments are evaluated in is up to the compiler.
+        for (size_t i = 0; i < count; ++i) {
+            auto x = uniform(dim[1]);
+            auto y = uniform(dim[0]);
+            vertices.emplace_back(x, y);
+        }
+        return vertices;
+    }
+
+    auto make_segments(size_t count, sycl::range<2> dim) {
+        std::vector<segment> segments;
+        segments.reserve(count);
+        uint64_t state = ~count;
+        auto uniform = [&](double scale) noexcept {
+            return (next_random(state) >> 11) * 0x1.0p-53 * scale;
+        };
+        for (size_t i = 0; i < count; ++i) {
+            segments.push_back({ uniform(dim[1]), uniform(dim[0]), uniform(dim[1]), uniform(dim[0]) });
+        }
+        return segments;
+    }
+
+    // Serial reference for the density of a frame of the scene under the
+    // identity view, in plain loops over every vertex's taps and every pixel
+    // near a segment, in the arithmetic of format. It takes nothing from the
+    // kernels but the formulas, so the binned splat has to match it exactly.
+    auto reference_density(std::string_view format,
+                           sycl::range<2> dim,
+                           std::vector<std::complex<double>> const& vertices,
+                           std::vector<segment> const& segments)
+    {
+        auto w = static_cast<int64_t>(dim[1]);
+        auto h = static_cast<int64_t>(dim[0]);
+        std::vector<uint32_t> density(dim.size());
+        auto add = [&](int64_t x, int64_t y, uint32_t v) noexcept {
+            if (0 <= x && x < w && 0 <= y && y < h) density[y * w + x] += v;
+        };
+        auto bilinear = [&](auto x, auto y) noexcept {
+            auto xq = std::floor(x);
+            auto yq = std::floor(y);
+            auto xr = x - xq;
+            auto yr = y - yq;
+            auto px = static_cast<int64_t>(xq);
+            auto py = static_cast<int64_t>(yq);
+            add(px + 0, py + 0, static_cast<uint32_t>(255 * (1 - xr) * (1 - yr)));
+            add(px + 0, py + 1, static_cast<uint32_t>(255 * (1 - xr) * yr));
+            add(px + 1, py + 0, static_cast<uint32_t>(255 * xr * (1 - yr)));
+            add(px + 1, py + 1, static_cast<uint32_t>(255 * xr * yr));
+        };
+        auto fixed = [&](double x, double y) noexcept {
+            auto encode = [](double v) noexcept {
+                return static_cast<int32_t>(std::clamp(std::floor(v * 65536 + 0.5), -2147483648.0, 2147483647.0));
+            };
+            auto fx = encode(x);
+            auto fy = encode(y);
+            uint64_t xr = fx & 0xffff;
+            uint64_t yr = fy & 0xffff;
+            uint64_t xi = 65536 - xr;
+            uint64_t yi = 65536 - yr;
+            add((fx >> 16) + 0, (fy >> 16) + 0, static_cast<uint32_t>((255 * xi * yi) >> 32));
+            add((fx >> 16) + 0, (fy >> 16) + 1, static_cast<uint32_t>((255 * xi * yr) >> 32));
+            add((fx >> 16) + 1, (fy >> 16) + 0, static_cast<uint32_t>((255 * xr * yi) >> 32));
+            add((fx >> 16) + 1, (fy >> 16) + 1, static_cast<uint32_t>((255 * xr * yr) >> 32));
+        };
+        // Tent across the segment, one pixel wide; nothing beyond a pixel
+        // from its bounding box is covered.
+        auto line = [&]<class T>(T ax, T ay, T bx, T by) noexcept {
+            auto x0 = static_cast<int64_t>(std::floor(std::min(ax, bx))) - 1;
+            auto y0 = static_cast<int64_t>(std::floor(std::min(ay, by))) - 1;
+            auto x1 = static_cast<int64_t>(std::floor(std::max(ax, bx))) + 1;
+            auto y1 = static_cast<int64_t>(std::floor(std::max(ay, by))) + 1;
+            for (auto y = std::max<int64_t>(y0, 0); y <= std::min(y1, h - 1); ++y) {
+                for (auto x = std::max<int64_t>(x0, 0); x <= std::min(x1, w - 1); ++x) {
+                    auto dx = bx - ax;
+                    auto dy = by - ay;
+                    auto ex = T(x) - ax;
+                    auto ey = T(y) - ay;
+                    auto len2 = dx * dx + dy * dy;
+                    auto t = len2 > 0 ? std::clamp((ex * dx + ey * dy) / len2, T(0), T(1)) : T(0);
+                    ex -= t * dx;
+                    ey -= t * dy;
+                    auto d2 = ex * ex + ey * ey;
+                    if (d2 < 1) add(x, y, static_cast<uint32_t>(255 * (1 - std::sqrt(d2))));
+                }
+            }
+        };
+        for (auto pt : vertices) {
+            if (format == fp64::name) bilinear(pt.real(), pt.imag());
+            else if (format == fixed16::name) fixed(pt.real(), pt.imag());
+            else bilinear(static_cast<float>(pt.real()), static_cast<float>(pt.imag()));
+        }
+        for (auto const& s : segments) {
+            if (format == fp64::name) line(s.ax, s.ay, s.bx, s.by);
+            else line(static_cast<float>(s.ax), static_cast<float>(s.ay), static_cast<float>(s.bx), static_cast<float>(s.by));
+        }
+        return density;
+    }
+
+    // How far the density of the narrower formats may stray from fp64's: one
+    // per vertex or segment that may reach the pixel. Each tap is truncated
+    // from a weight within a fraction of one of fp64's, and a coordinate
+    // rounded up to the next integer moves a vertex's corner by a pixel.
+    auto reference_slack(sycl::range<2> dim,
+                         std::vector<std::complex<double>> const& vertices,
+                         std::vector<segment> const& segments)
+    {
+        auto w = static_cast<int64_t>(dim[1]);
+        auto h = static_cast<int64_t>(dim[0]);
+        std::vector<uint32_t> slack(dim.size());
+        auto reach = [&](double x0, double y0, double x1, double y1, int64_t grow) noexcept {
+            auto px0 = std::max<int64_t>(static_cast<int64_t>(std::floor(x0)) - grow, 0);
+            auto py0 = std::max<int64_t>(static_cast<int64_t>(std::floor(y0)) - grow, 0);
+            auto px1 = std::min<int64_t>(static_cast<int64_t>(std::floor(x1)) + 2, w - 1);
+            auto py1 = std::min<int64_t>(static_cast<int64_t>(std::floor(y1)) + 2, h - 1);
+            for (auto y = py0; y <= py1; ++y) {
+                for (auto x = px0; x <= px1; ++x) ++slack[y * w + x];
+            }
+        };
+        for (auto pt : vertices) reach(pt.real(), pt.imag(), pt.real(), pt.imag(), 0);
+        for (auto const& s : segments) {
+            reach(std::min(s.ax, s.bx), std::min(s.ay, s.by), std::max(s.ax, s.bx), std::max(s.ay, s.by), 2);
+        }
+        return slack;
+    }
+
+    // Pixels whose density differs from the reference's, by more than slack
+    // if given.
+    inline size_t mismatches(std::vector<uint32_t> const& density,
+                             std::vector<uint32_t> const& reference,
+                             std::vector<uint32_t> const* slack = nullptr) noexcept
+    {
+        size_t ret = 0;
+        for (size_t k = 0; k < density.size(); ++k) {
+            auto diff = density[k] < reference[k] ? reference[k] - density[k] : density[k] - reference[k];
+            ret += diff > (slack ? (*slack)[k] : 0);
+        }
+        return ret;
+    }
+
+    inline double elapsed_ms(sycl::event const& event) {
+        auto start = event.get_profiling_info<sycl::info::event_profiling::command_start>();
+        auto end = event.get_profiling_info<sycl::info::event_profiling::command_end>();
+        return (end - start) * 1e-6;
+    }
+
+    // The main queue first, then one per band; see make_queues().
+    auto make_queues(std::string_view selector, std::string_view bands) {
+        auto props = sycl::property_list{sycl::property::queue::in_order{},
+                                         sycl::property::queue::enable_profiling{}};
+        if (selector == "cpu") return ::make_queues(sycl::device{sycl::cpu_selector_v}, bands, props);
+        if (selector == "gpu") return ::make_queues(sycl::device{sycl::gpu_selector_v}, bands, props);
+        return ::make_queues(sycl::device{sycl::default_selector_v}, bands, props);
+    }
+} // ::benchmark_helper
+
+int main(int argc, char** argv) {
+    options opts;
+    if (!parse(argc, argv, opts)) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--vertices 1000,50e6] [--segments 0,1000] [--sizes 1024x768,3840x2160]"
+                  << " [--devices default,cpu,gpu] [--bands 0,numa,4] [--formats fp64,fp32,fixed16] [--frames 20]"
+                  << (checking ? " [--expect bench.expect]" : "")
+                  << std::endl;
+        return 1;
+    }
+    std::map<std::string, uint64_t> expected;
+    if (!opts.expect.empty() && !load_expectations(opts.expect, expected)) return 1;
+    size_t mismatches = 0;
+    size_t divergences = 0;
+    for (auto dim : opts.sizes) {
+        for (auto count : opts.vertices) {
+            for (auto segment_count : opts.segments) {
+                auto vertices = make_scene(count, dim);
+                auto segments = make_segments(segment_count, dim);
+                std::vector<uint32_t> exact, slack;
+                if (checking) {
+                    exact = reference_density(fp64::name, dim, vertices, segments);
+                    slack = reference_slack(dim, vertices, segments);
+                }
+                for (auto const& selector : opts.devices) {
+                    for (auto const& banding : opts.bands) {
+                        for (auto const& format : opts.formats) {
+                            std::cout << "{\"device\":\"" << selector << "\",\"format\":\"" << format
+                                      << "\",\"width\":" << dim[1] << ",\"height\":" << dim[0]
+                                      << ",\"vertices\":" << count << ",\"segments\":" << segment_count
+                                      << ",\"bands\":\"" << banding << "\",\"frames\":" << opts.frames;
+                            try {
+                                auto queues = make_queues(selector, banding);
+                                auto& que = queues.front();
+                                auto device = que.get_device();
+                                std::cout << ",\"device_name\":\"" << device.get_info<sycl::info::device::name>() << '"';
+                                if (format == fp64::name && !device.has(sycl::aspect::fp64)) {
+                                    std::cout << ",\"skipped\":\"no fp64\"}" << std::endl;
+                                    continue;
+                                }
+                                auto kind = queues.size() > 1 ? sycl::usm::alloc::shared : sycl::usm::alloc::device;
+                                auto store = make_vertex_store(format, que, kind);
+                                tile_bins bins{que, dim};
+                                std::vector<std::unique_ptr<render_band>> bands;
+                                for (size_t i = 1; i < queues.size(); ++i) {
+                                    bands.push_back(std::make_unique<render_band>(queues[i], dim));
+                                }
+                                if (!bins || std::ranges::any_of(bands, [](auto const& band) noexcept { return !band->bins; })) {
+                                    std::cout << ",\"error\":\"allocation failed\"}" << std::endl;
+                                    continue;
+                                }
+                                tone_map tones{que};
+                                auto density = malloc_unique<uint32_t>(dim.size(), que, kind);
+                                if (!tones || !density) {
+                                    std::cout << ",\"error\":\"allocation failed\"}" << std::endl;
+                                    continue;
+                                }
+                                first_touch(bands, density.get(), dim);
+                                std::vector<uint32_t> pixels(dim.size());
+                                usm_unique_ptr<uint32_t> framebuffer{nullptr, usm_deleter{&que}};
+                                if (!device.has(sycl::aspect::usm_system_allocations)) {
+                                    framebuffer = malloc_device_unique<uint32_t>(dim.size(), que);
+                                }
+                                auto full = std::vector<rect>{{ 0, 0, static_cast<int32_t>(dim[1]), static_cast<int32_t>(dim[0]) }};
+                                stats upload, frame, count_kernel, scan_kernel, scatter_kernel, splat_kernel, tone_kernel;
+                                bool ok = std::visit([&](auto& store) {
+                                    auto t0 = std::chrono::steady_clock::now();
+                                    if (!store.set_cursor(que, vertices.front())) return false;
+                                    if (!store.append(que, std::span(vertices).subspan(1))) return false;
+                                    if (!store.append(que, std::span<segment const>(segments))) return false;
+                                    if (!store.reindex(que)) return false;
+                                    que.wait();
+                                    store.settle();
+                                    auto t1 = std::chrono::steady_clock::now();
+                                    upload.samples.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+                                    for (size_t i = 0; i < opts.frames; ++i) {
+                                        auto f0 = std::chrono::steady_clock::now();
+                                        auto target = framebuffer ? framebuffer.get() : pixels.data();
+                                        auto events = bands.empty()
+                                            ? std::vector{ rendering(que, density.get(), dim, store, bins, viewport{}, full) }
+                                            : banded_rendering(bands, density.get(), dim, store, viewport{}, full);
+                                        [[maybe_unused]] auto remap = tones.update(que, density.get(), dim, true);
+                                        auto tone = tone_mapping<argb8888>(que, target, dim[1], dim, density.get(), tones, vertices.front(), full);
+                                        if (framebuffer) presenting<argb8888>(que, framebuffer.get(), pixels.data(), dim[1], dim, full);
+                                        que.wait();
+                                        auto f1 = std::chrono::steady_clock::now();
+                                        frame.samples.push_back(std::chrono::duration<double, std::milli>(f1 - f0).count());
+                                        // The slowest band of each stage.
+                                        auto slowest = [&](auto stage) {
+                                            double ret = 0;
+                                            for (auto const& band : events) ret = std::max(ret, elapsed_ms(band.*stage));
+                                            return ret;
+                                        };
+                                        count_kernel.samples.push_back(slowest(&render_events::count));
+                                        scan_kernel.samples.push_back(slowest(&render_events::scan));
+                                        scatter_kernel.samples.push_back(slowest(&render_events::scatter));
+                                        splat_kernel.samples.push_back(slowest(&render_events::splat));
+                                        tone_kernel.samples.push_back(elapsed_ms(tone));
+                                    }
+                                    return true;
+                                }, store);
+                                if (!ok) {
+                                    std::cout << ",\"error\":\"allocation failed\"}" << std::endl;
+                                    continue;
+                                }
+                                size_t diverged = 0, strayed = 0;
+                                if (checking) {
+                                    std::vector<uint32_t> sums(dim.size());
+                                    que.memcpy(sums.data(), density.get(), dim.size() * sizeof (uint32_t)).wait();
+                                    diverged = mismatches(sums, format == fp64::name ? exact : reference_density(format, dim, vertices, segments));
+                                    strayed = format == fp64::name ? 0 : mismatches(sums, exact, &slack);
+                                    if (diverged || strayed) ++divergences;
+                                }
+                                std::cout << ",\"upload_ms\":";
+                                upload.print(std::cout);
+                                std::cout << ",\"frame_ms\":";
+                                frame.print(std::cout);
+                                std::cout << ",\"kernel_ms\":{\"count\":";
+                                count_kernel.print(std::cout);
+                                std::cout << ",\"scan\":";
+                                scan_kernel.print(std::cout);
+                                std::cout << ",\"scatter\":";
+                                scatter_kernel.print(std::cout);
+                                std::cout << ",\"splat\":";
+                                splat_kernel.print(std::cout);
+                                std::cout << ",\"tone\":";
+                                tone_kernel.print(std::cout);
+                                auto sum = checksum(checksum_basis, pixels.data(), pixels.size());
+                                std::cout << '}';
+                                if (checking) {
+                                    std::cout << ",\"reference_mismatches\":" << diverged
+                                              << ",\"fp64_mismatches\":" << strayed;
+                                }
+                                std::cout << ",\"checksum\":\"" << std::hex << sum << std::dec << '"';
+                                if (auto golden = expected.find(configuration(format, dim, count, segment_count)); golden != expected.end()) {
+                                    auto match = golden->second == sum;
+                                    if (!match) ++mismatches;
+                                    std::cout << ",\"expected\":\"" << std::hex << golden->second << std::dec
+                                              << "\",\"match\":" << (match ? "true" : "false");
+                                }
+                                std::cout << '}' << std::endl;
+                            }
+                            catch (sycl::exception& ex) {
+                                std::cout << ",\"error\":\"" << ex.what() << "\"}" << std::endl;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if (divergences) {
+        std::cerr << divergences << " frames differ from the serial reference or stray from fp64" << std::endl;
+    }
+    if (mismatches) {
+        std::cerr << mismatches << " checksum mismatches" << std::endl;
+    }
+    return mismatches || divergences ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <coroutine>
+#include <utility>
+
+// Lazily started coroutine yielding a T, which a caller either co_awaits
+// (resuming once it finishes) or drives with operator() when it runs to
+// completion without suspending.
+inline namespace coroutines
+{
+    template <class T>
+    struct delay {
+        struct promise_type {
+            std::coroutine_handle<> continuation;
+            T value;
+            void unhandled_exception() { throw; }
+            auto get_return_object() noexcept { return delay{*this}; }
+            auto initial_suspend() noexcept { return std::suspend_always{}; }
+            auto final_suspend() noexcept {
+                struct awaiter : std::suspend_always {
+                    auto await_suspend(std::coroutine_handle<promise_type> handle) const noexcept
+                        -> std::coroutine_handle<>
+                    {
+                        /*
+                          awaiter::await_suspend is called when the execution of the
+                          current coroutine (referred to by 'handle') is about to finish.
+                          If the current coroutine was resumed by another coroutine via
+                          co_await get_delay(), a handle to that coruitne has been stored
+                          as handle.promise().continuation. In that case, return the handle
+                          to resume the previous coroutine.
+                          Otherwise, return noop_coroutine(), whose resumption does nothing.
+                        */
+                        if (auto continuation = handle.promise().continuation) {
+                            return continuation;
+                        }
+                        return std::noop_coroutine();
+                    }
+                };
+                return awaiter{};
+            }
+            void return_value(T value) noexcept { this->value = std::move(value); }
+        };
+        std::coroutine_handle<promise_type> handle;
+        ~delay() noexcept {
+            if (this->handle) this->handle.destroy();
+        }
+        delay(delay const&) = delete;
+        delay(delay&& rhs) noexcept
+            : handle{std::exchange(rhs.handle, nullptr)}
+        {
+        }
+        auto operator co_await() noexcept {
+            struct awaiter : std::suspend_always {
+                std::coroutine_handle<promise_type> handle;
+                awaiter(std::coroutine_handle<promise_type> handle) : handle{handle}
+                {
+                }
+                T await_resume() noexcept { return std::move(this->handle.promise().value); }
+                auto await_suspend(std::coroutine_handle<> handle) noexcept {
+                    this->handle.promise().continuation = handle;
+                    return this->handle;
+                }
+            };
+            return awaiter{this->handle};
+        }
+        T operator()() noexcept {
+            this->handle.resume();
+            return std::move(this->handle.promise().value);
+        }
+        // What it co_returned, once done, as when driven by executor::run().
+        T const& result() const noexcept { return this->handle.promise().value; }
+    private:
+        explicit delay(promise_type& p) noexcept
+            : handle{std::coroutine_handle<promise_type>::from_promise(p)}
+        {
+        }
+    };
+} // ::coroutines
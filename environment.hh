@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdlib>
+#include <string_view>
+
+// The value of the environment variable name, empty if it is unset. It views
+// the environment's own string, so data() is a C string too.
+[[nodiscard]] inline std::string_view environment(char const* name) noexcept {
+    auto value = std::getenv(name);
+    return value ? value : "";
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <complex>
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <CL/sycl.hpp>
+
+#include "delay.hh"
+#include "rendering.hh"
+#include "scene.hh"
+#include "tracing.hh"
+
+// What frames are drawn with, kept from frame to frame; bands and layer may
+// be empty.
+struct renderer {
+    sycl::queue* que;
+    std::vector<std::unique_ptr<render_band>>* bands;
+    any_vertex_store* store;
+    tile_bins* bins;
+    tone_map* tones;
+    splat_layer const* layer;
+    frame_trace* trace;
+};
+
+// For draw_frame() callers with nothing else to do meanwhile.
+inline auto blocking(sycl::queue& que) noexcept {
+    que.wait();
+    return std::suspend_never{};
+}
+
+// Draws the scene's current frame into density, then calls
+// present(damage, cursor, remapped) to submit the tone mapping. co_await
+// wait(queue) waits for a queue to drain; with blocking() the frame is done
+// on return. The caller ends the frame in the trace.
+template <class Wait, class Present>
+delay<bool> draw_frame(renderer r, scene& scene, uint32_t* density, sycl::range<2> dim, Wait wait, Present present) {
+    auto& que = *r.que;
+    auto& bands = *r.bands;
+    auto& trace = *r.trace;
+    scene.track_cursor();
+    r.tones->curve = scene.curve;
+    auto damage = std::exchange(scene.damage, {});
+    auto reshaped = std::exchange(scene.reshaped, false);
+    auto cursor = scene.cursor;
+    auto view = scene.view;
+    scene.dirty = false;
+    auto record = [&](render_events const& events) noexcept {
+        trace.device("count", events.count);
+        trace.device("scan", events.scan);
+        trace.device("scatter", events.scatter);
+        trace.device("splat", events.splat);
+    };
+    render_events events;
+    std::vector<render_events> banded;
+    auto submitted = trace.begin_frame();
+    auto ok = std::visit([&](auto& store) noexcept {
+        if (!store.set_cursor(que, view.to_world(cursor))) return false;
+        if (!store.append(que, std::span<primitive const>(scene.primitives))) return false;
+        if (!store.append(que, std::span<segment const>(scene.segments))) return false;
+        if (!store.reindex(que)) return false;
+        if (bands.empty()) events = binning(que, dim, store, *r.bins, view, damage);
+        else banded = banded_binning(bands, dim, store, view, damage, joining(que, {}));
+        return true;
+    }, *r.store);
+    // The store has taken its own copy of these.
+    scene.primitives.clear();
+    scene.segments.clear();
+    if (!ok) co_return false;
+    trace.host("submit bin", submitted);
+    // Bins are sized by what binning() counted.
+    auto binned = trace.now();
+    co_await wait(que);
+    for (auto const& band : bands) co_await wait(*band->que);
+    trace.host("bin", binned);
+    auto splatted = trace.now();
+    std::visit([&](auto& store) noexcept {
+        if (bands.empty()) {
+            record(splatting(que, density, dim, store, *r.bins, view, events, r.layer));
+            return ;
+        }
+        banded_splatting(bands, density, dim, store, view, banded, r.layer);
+        std::vector<sycl::event> splats;
+        for (auto const& band : banded) {
+            record(band);
+            splats.push_back(band.splat);
+        }
+        joining(que, splats);
+    }, *r.store);
+    // A new table changes pixels anywhere in the frame.
+    auto remapped = r.tones->update(que, density, dim, reshaped);
+    if (remapped) damage = { rect{ 0, 0, static_cast<int32_t>(dim[1]), static_cast<int32_t>(dim[0]) } };
+    if (!present(damage, cursor, remapped)) co_return false;
+    trace.host("submit splat", splatted);
+    auto waited = trace.now();
+    co_await wait(que);
+    trace.host("wait", waited);
+    std::visit([](auto& store) noexcept { store.settle(); }, *r.store);
+    co_return true;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <wayland-client.h>
+#include "presentation-time-client-protocol.h"
+
+// Counts of latencies in 1 ms buckets; the last bucket also holds everything
+// longer.
+struct latency_histogram {
+    static constexpr size_t buckets = 100;
+    std::array<size_t, buckets> counts{};
+    size_t total = 0;
+
+    void add(double ms) noexcept {
+        auto bucket = ms < 0 ? 0 : std::min(static_cast<size_t>(ms), buckets - 1);
+        ++this->counts[bucket];
+        ++this->total;
+    }
+    // Upper edge of the bucket holding the nearest-rank q-th sample.
+    [[nodiscard]] size_t percentile(double q) const noexcept {
+        auto rank = std::clamp<size_t>(std::ceil(q * this->total), 1, this->total);
+        size_t seen = 0;
+        for (size_t i = 0; i < buckets; ++i) {
+            seen += this->counts[i];
+            if (rank <= seen) return i + 1;
+        }
+        return buckets;
+    }
+    void print(std::ostream& output, char const* title) const {
+        output << title << ", " << this->total << " frames";
+        if (this->total == 0) {
+            output << std::endl;
+            return ;
+        }
+        output << ": p50 <" << this->percentile(0.5) << "ms p90 <" << this->percentile(0.9)
+               << "ms p99 <" << this->percentile(0.99) << "ms\n";
+        auto peak = *std::ranges::max_element(this->counts);
+        for (size_t i = 0; i < buckets; ++i) {
+            if (this->counts[i] == 0) continue;
+            output << std::setw(4) << i << (i + 1 == buckets ? "+ " : "  ")
+                   << std::string((this->counts[i] * 50 + peak - 1) / peak, '#')
+                   << ' ' << this->counts[i] << '\n';
+        }
+        output << std::flush;
+    }
+};
+
+// Latency from the oldest input of a frame, and from its commit, to its
+// presentation, on the clock announced by clock_id. Input timestamps are only
+// comparable where the compositor stamps them on that clock, or when replayed
+// with now_ms(). Construct before the first roundtrip, with nullptr to disable.
+struct latency_meter {
+    struct frame {
+        latency_meter* meter;
+        struct wp_presentation_feedback* feedback;
+        uint64_t committed;            // ns on the presentation clock
+        std::optional<uint32_t> input; // ms, the oldest input event in the frame
+    };
+    wp_presentation* presentation = nullptr;
+    clockid_t clock = CLOCK_MONOTONIC;
+    std::optional<uint32_t> unseen;  // oldest input event since the last snapshot
+    std::optional<uint32_t> snapped; // the same, as of the frame being drawn
+    std::list<frame> frames;         // committed, awaiting feedback
+    latency_histogram input_latency;
+    latency_histogram commit_latency;
+    size_t dropped = 0;
+
+    explicit latency_meter(wp_presentation* presentation) noexcept
+        : presentation{presentation}
+    {
+        static constexpr wp_presentation_listener listener {
+            .clock_id = [](void* data, wp_presentation*, uint32_t clock) noexcept {
+                reinterpret_cast<latency_meter*>(data)->clock = static_cast<clockid_t>(clock);
+            },
+        };
+        if (this->presentation && wp_presentation_add_listener(this->presentation, &listener, this)) {
+            std::cerr << "wp_presentation_add_listener failed..." << std::endl;
+            this->presentation = nullptr;
+        }
+    }
+    latency_meter(latency_meter const&) = delete;
+    ~latency_meter() noexcept {
+        for (auto& f : this->frames) wp_presentation_feedback_destroy(f.feedback);
+    }
+    explicit operator bool() const noexcept { return this->presentation != nullptr; }
+
+    [[nodiscard]] uint64_t now() const noexcept {
+        timespec ts;
+        clock_gettime(this->clock, &ts);
+        return uint64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+    }
+    // An input event's time as a listener would have received it.
+    [[nodiscard]] uint32_t now_ms() const noexcept {
+        return static_cast<uint32_t>(this->now() / 1'000'000);
+    }
+    void input(uint32_t time) noexcept {
+        if (!this->unseen) this->unseen = time;
+    }
+    // Everything input so far goes into the frame drawn next.
+    void snapshot() noexcept {
+        if (this->unseen) this->snapped = std::exchange(this->unseen, std::nullopt);
+    }
+    // Asks for feedback on the commit about to be made to surface.
+    void commit(wl_surface* surface) noexcept {
+        static constexpr wp_presentation_feedback_listener feedback_listener {
+            .sync_output = [](auto...) noexcept { },
+            .presented = [](void* data, struct wp_presentation_feedback*,
+                            uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+                            uint32_t, uint32_t, uint32_t, uint32_t) noexcept {
+                auto f = reinterpret_cast<frame*>(data);
+                auto presented = ((uint64_t(tv_sec_hi) << 32) | tv_sec_lo) * 1'000'000'000 + tv_nsec;
+                f->meter->presented(f, presented);
+            },
+            .discarded = [](void* data, struct wp_presentation_feedback*) noexcept {
+                auto f = reinterpret_cast<frame*>(data);
+                f->meter->discarded(f);
+            },
+        };
+        if (!*this) return;
+        auto feedback = wp_presentation_feedback(this->presentation, surface);
+        if (!feedback) {
+            std::cerr << "wp_presentation_feedback failed..." << std::endl;
+            return ;
+        }
+        auto& f = this->frames.emplace_back(frame{ this, feedback, this->now(), std::exchange(this->snapped, std::nullopt) });
+        wp_presentation_feedback_add_listener(feedback, &feedback_listener, &f);
+    }
+
+    void report(std::ostream& output) const {
+        if (!*this) return;
+        this->input_latency.print(output, "Input to presentation (ms)");
+        this->commit_latency.print(output, "Commit to presentation (ms)");
+        output << "Discarded: " << this->dropped << " frames" << std::endl;
+    }
+
+private:
+    void presented(frame* f, uint64_t presented) noexcept {
+        if (f->input) {
+            // Millisecond timestamps wrap around; the difference does not.
+            auto ms = static_cast<int32_t>(static_cast<uint32_t>(presented / 1'000'000) - *f->input);
+            this->input_latency.add(ms);
+        }
+        this->commit_latency.add((int64_t(presented) - int64_t(f->committed)) * 1e-6);
+        this->retire(f);
+    }
+    // The input of a frame never shown reaches the screen with a later one.
+    void discarded(frame* f) noexcept {
+        ++this->dropped;
+        if (f->input) {
+            auto next = std::find_if(this->frames.begin(), this->frames.end(), [f](auto const& other) noexcept {
+                return std::addressof(other) == f;
+            });
+            if (++next != this->frames.end()) next->input = f->input;
+            else if (this->snapped) this->snapped = f->input;
+            else this->unseen = f->input;
+        }
+        this->retire(f);
+    }
+    void retire(frame* f) noexcept {
+        wp_presentation_feedback_destroy(f->feedback);
+        std::erase_if(this->frames, [f](auto const& other) noexcept { return std::addressof(other) == f; });
+    }
+};
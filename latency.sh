@@ -0,0 +1,104 @@
+#!/bin/sh
+# Runs graphio on a private headless Weston, replaying an input log recorded
+# with GRAPHIO_RECORD, and prints its presentation latency histograms. Without
+# a log it replays a synthetic one: the pointer sweeping the surface at 60 Hz
+# for three seconds, right-clicking every half second and scrolling in between.
+# Fails unless frames were presented and measured.
+#
+#   latency.sh <graphio> [input log]
+#
+# WESTON_FLAGS overrides the backend and shell options, whose spelling
+# differs between Weston releases.
+set -eu
+
+graphio=$1
+log=${2:-}
+
+# The little-endian bytes of $1, $2 of them.
+bytes() {
+    value=$1
+    count=$2
+    while [ "$count" -gt 0 ]; do
+        # shellcheck disable=SC2059
+        printf "\\$(printf '%03o' $((value & 255)))"
+        value=$((value >> 8))
+        count=$((count - 1))
+    done
+}
+
+# An input_event of scene.hh: time (ns) kind state code x y.
+event() {
+    bytes "$1" 8
+    bytes "$2" 2
+    bytes "$3" 2
+    bytes "$4" 4
+    bytes "$5" 4
+    bytes "$6" 4
+}
+
+synthesize() {
+    printf graphio1
+    frame=0
+    while [ "$frame" -lt 180 ]; do
+        time=$((frame * 16666667))
+        # motion, at wl_fixed coordinates
+        event "$time" 0 0 0 $(((100 + frame * 4) * 256)) $(((100 + frame * 2) * 256))
+        if [ $((frame % 30)) -eq 15 ]; then
+            # BTN_RIGHT pressed and released
+            event $((time + 1000000)) 1 1 273 0 0
+            event $((time + 2000000)) 1 0 273 0 0
+        elif [ $((frame % 30)) -eq 0 ]; then
+            # a notch of vertical scroll
+            event $((time + 1000000)) 2 0 0 $((10 * 256)) 0
+        fi
+        frame=$((frame + 1))
+    done
+}
+
+runtime=$(mktemp -d)
+weston=
+cleanup() {
+    if [ -n "$weston" ]; then
+        kill "$weston" 2>/dev/null || true
+        wait "$weston" 2>/dev/null || true
+    fi
+    rm -rf "$runtime"
+}
+trap cleanup EXIT INT TERM
+
+export XDG_RUNTIME_DIR=$runtime
+export WAYLAND_DISPLAY=graphio-latency
+# shellcheck disable=SC2086
+weston ${WESTON_FLAGS:---backend=headless-backend.so --shell=fullscreen-shell.so} \
+       --socket="$WAYLAND_DISPLAY" --idle-time=0 >"$runtime/weston.log" 2>&1 &
+weston=$!
+
+tries=0
+until [ -S "$runtime/$WAYLAND_DISPLAY" ]; do
+    tries=$((tries + 1))
+    if [ "$tries" -gt 100 ] || ! kill -0 "$weston" 2>/dev/null; then
+        echo "latency.sh: weston did not start" >&2
+        cat "$runtime/weston.log" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+if [ -z "$log" ]; then
+    log=$runtime/synthetic.log
+    synthesize >"$log"
+fi
+
+status=0
+GRAPHIO_LATENCY=1 GRAPHIO_REPLAY=$log "$graphio" >"$runtime/graphio.log" || status=$?
+cat "$runtime/graphio.log"
+if [ "$status" -ne 0 ]; then
+    echo "latency.sh: graphio failed" >&2
+    exit "$status"
+fi
+
+presented=$(sed -n 's/^Commit to presentation (ms), \([0-9]*\) frames.*/\1/p' "$runtime/graphio.log")
+if [ "${presented:-0}" -eq 0 ]; then
+    echo "latency.sh: no frames were presented" >&2
+    exit 1
+fi
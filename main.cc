@@ -4,88 +4,210 @@
 #include <coroutine>
 #include <concepts>
 #include <memory>
+#include <functional>
+#include <atomic>
+#include <cerrno>
 #include <list>
+#include <optional>
 #include <vector>
+#include <array>
 #include <tuple>
 #include <string>
-#include <filesystem>
+#include <chrono>
+#include <limits>
 #include <complex>
+#include <cmath>
 #include <numbers>
 #include <ranges>
 
 #include <CL/sycl.hpp>
 
+#include "delay.hh"
+#include "environment.hh"
+#include "rendering.hh"
+#include "tracing.hh"
+#include "streaming.hh"
+#include "scene.hh"
+#include "latency.hh"
+#include "frame.hh"
+
 #include <wayland-client.h>
+#include "fullscreen-shell-unstable-v1-client-protocol.h"
 #include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
-#include <linux/input-event-codes.h>
 
 inline namespace coroutines
 {
-    template <class T>
-    struct delay {
-        struct promise_type {
-            std::coroutine_handle<> continuation;
-            T value;
-            void unhandled_exception() { throw; }
-            auto get_return_object() noexcept { return delay{*this}; }
-            auto initial_suspend() noexcept { return std::suspend_always{}; }
-            auto final_suspend() noexcept {
-                struct awaiter : std::suspend_always {
-                    auto await_suspend(std::coroutine_handle<promise_type> handle) const noexcept
-                        -> std::coroutine_handle<>
-                    {
-                        /*
-                          awaiter::await_suspend is called when the execution of the
-                          current coroutine (referred to by 'handle') is about to finish.
-                          If the current coroutine was resumed by another coroutine via
-                          co_await get_delay(), a handle to that coruitne has been stored
-                          as handle.promise().continuation. In that case, return the handle
-                          to resume the previous coroutine.
-                          Otherwise, return noop_coroutine(), whose resumption does nothing.
-                        */
-                        if (auto continuation = handle.promise().continuation) {
-                            return continuation;
-                        }
-                        return std::noop_coroutine();
-                    }
-                };
-                return awaiter{};
-            }
-            void return_value(T value) noexcept { this->value = std::move(value); }
+    // Single-threaded executor for delay<> coroutines. A suspended coroutine
+    // waits on a condition, which is re-checked whenever something may have
+    // changed it: after Wayland events were dispatched (the listeners update
+    // the state the conditions look at), and after device work completed,
+    // which a host task announces through an eventfd. The thread only sleeps,
+    // in poll() on both descriptors, when no condition holds, and no longer
+    // than until the earliest deadline a coroutine waits for.
+    struct executor {
+        using clock = std::chrono::steady_clock;
+        struct waiter {
+            std::function<bool()> ready;
+            std::coroutine_handle<> handle;
+            clock::time_point deadline = clock::time_point::max();
         };
-        std::coroutine_handle<promise_type> handle;
-        ~delay() noexcept {
-            if (this->handle) this->handle.destroy();
-        }
-        delay(delay const&) = delete;
-        delay(delay&& rhs) noexcept
-            : handle{std::exchange(rhs.handle, nullptr)}
+        wl_display* display;
+        frame_trace* trace;
+        int wakeup;
+        std::vector<waiter> waiting;
+
+        executor(wl_display* display, frame_trace* trace) noexcept
+            : display{display}, trace{trace}, wakeup{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)}
         {
         }
-        auto operator co_await() noexcept {
+        ~executor() noexcept {
+            if (this->wakeup != -1) close(this->wakeup);
+        }
+        executor(executor const&) = delete;
+        explicit operator bool() const noexcept { return this->wakeup != -1; }
+
+        // co_await until(f) resumes once f() holds.
+        auto until(std::function<bool()> ready) noexcept {
             struct awaiter : std::suspend_always {
-                std::coroutine_handle<promise_type> handle;
-                awaiter(std::coroutine_handle<promise_type> handle) : handle{handle}
-                {
+                executor* ex;
+                std::function<bool()> ready;
+                bool await_ready() const { return this->ready(); }
+                void await_suspend(std::coroutine_handle<> handle) {
+                    this->ex->waiting.push_back({ std::move(this->ready), handle });
                 }
-                T await_resume() noexcept { return std::move(this->handle.promise().value); }
-                auto await_suspend(std::coroutine_handle<> handle) noexcept {
-                    this->handle.promise().continuation = handle;
-                    return this->handle;
+            };
+            return awaiter{{}, this, std::move(ready)};
+        }
+        // co_await at(t) resumes once the steady clock has reached t, or
+        // sooner once sooner(), if given, returns true.
+        auto at(clock::time_point deadline, std::function<bool()> sooner = {}) noexcept {
+            struct awaiter : std::suspend_always {
+                executor* ex;
+                clock::time_point deadline;
+                std::function<bool()> sooner;
+                bool await_ready() const { return this->deadline <= clock::now() || (this->sooner && this->sooner()); }
+                void await_suspend(std::coroutine_handle<> handle) {
+                    auto ready = [deadline = this->deadline, sooner = std::move(this->sooner)]() {
+                        return deadline <= clock::now() || (sooner && sooner());
+                    };
+                    this->ex->waiting.push_back({ std::move(ready), handle, this->deadline });
                 }
             };
-            return awaiter{this->handle};
+            return awaiter{{}, this, deadline, std::move(sooner)};
         }
-        T operator()() noexcept {
-            this->handle.resume();
-            return std::move(this->handle.promise().value);
+        // co_await completion(que, event) resumes once event, and everything
+        // submitted before it to the in-order que, has completed.
+        auto completion(sycl::queue& que, sycl::event event = {}) noexcept {
+            struct awaiter : std::suspend_always {
+                executor* ex;
+                sycl::queue* que;
+                sycl::event event;
+                std::atomic<bool> done = false;
+                void await_suspend(std::coroutine_handle<> handle) {
+                    auto done = &this->done;
+                    auto wakeup = this->ex->wakeup;
+                    this->que->submit([&](sycl::handler& h) {
+                        h.depends_on(this->event);
+                        h.host_task([=]() noexcept {
+                            done->store(true);
+                            uint64_t one = 1;
+                            [[maybe_unused]] auto ret = write(wakeup, &one, sizeof one);
+                        });
+                    });
+                    this->ex->waiting.push_back({ [done]() noexcept { return done->load(); }, handle });
+                }
+            };
+            return awaiter{{}, this, &que, std::move(event)};
         }
+
+        // Drives tasks until all of them have finished; false if the display
+        // connection failed first.
+        template <class... T>
+        bool run(delay<T>&... tasks) noexcept {
+            auto finished = [&]() noexcept { return (tasks.handle.done() && ...); };
+            (tasks.handle.resume(), ...);
+            while (!finished()) {
+                this->resume_ready();
+                if (finished()) break;
+                if (!this->poll()) return false;
+            }
+            return true;
+        }
+
     private:
-        explicit delay(promise_type& p) noexcept
-            : handle{std::coroutine_handle<promise_type>::from_promise(p)}
-        {
+        bool any_ready() const noexcept {
+            return std::ranges::any_of(this->waiting, [](auto const& w) noexcept { return w.ready(); });
+        }
+        void resume_ready() noexcept {
+            // A resumed coroutine may satisfy (or add) other waiters, so start
+            // over after each one.
+            for (bool progress = true; progress; ) {
+                progress = false;
+                for (auto w = this->waiting.begin(); w != this->waiting.end(); ++w) {
+                    if (w->ready()) {
+                        auto handle = w->handle;
+                        this->waiting.erase(w);
+                        handle.resume();
+                        progress = true;
+                        break;
+                    }
+                }
+            }
+        }
+        // Milliseconds until the earliest deadline, or -1 for none.
+        int timeout() const noexcept {
+            auto deadline = clock::time_point::max();
+            for (auto const& w : this->waiting) deadline = std::min(deadline, w.deadline);
+            if (deadline == clock::time_point::max()) return -1;
+            auto ms = std::chrono::ceil<std::chrono::milliseconds>(deadline - clock::now()).count();
+            return static_cast<int>(std::clamp<decltype (ms)>(ms, 0, std::numeric_limits<int>::max()));
+        }
+        // One round of the wl_display_prepare_read() protocol, also woken by
+        // device completions and deadlines.
+        bool poll() noexcept {
+            auto dispatched = frame_trace::now();
+            while (wl_display_prepare_read(this->display) != 0) {
+                if (wl_display_dispatch_pending(this->display) == -1) return false;
+            }
+            if (this->any_ready()) {
+                wl_display_cancel_read(this->display);
+                this->trace->host("dispatch", dispatched);
+                return true;
+            }
+            // Requests the socket had no room for wait for it to drain.
+            auto flushed = wl_display_flush(this->display);
+            if (flushed == -1 && errno != EAGAIN) {
+                wl_display_cancel_read(this->display);
+                return false;
+            }
+            pollfd fds[] = {
+                { wl_display_get_fd(this->display), short(flushed == -1 ? POLLIN | POLLOUT : POLLIN), 0 },
+                { this->wakeup, POLLIN, 0 },
+            };
+            auto polled = frame_trace::now();
+            if (::poll(fds, std::size(fds), this->timeout()) == -1) {
+                wl_display_cancel_read(this->display);
+                return errno == EINTR;
+            }
+            this->trace->host("poll", polled);
+            dispatched = frame_trace::now();
+            if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+                if (wl_display_read_events(this->display) == -1) return false;
+            }
+            else {
+                wl_display_cancel_read(this->display);
+            }
+            if (fds[1].revents & POLLIN) {
+                uint64_t count;
+                [[maybe_unused]] auto ret = read(this->wakeup, &count, sizeof count);
+            }
+            if (wl_display_dispatch_pending(this->display) == -1) return false;
+            this->trace->host("dispatch", dispatched);
+            return true;
         }
     };
 } // ::coroutines
@@ -110,6 +232,8 @@ inline namespace wayland_client_helper
     INTERN_WL_INTERFACE(wl_shm_pool);
     INTERN_WL_INTERFACE(wl_callback);
     INTERN_WL_INTERFACE(wl_output);
+    INTERN_WL_INTERFACE(wp_presentation);
+    INTERN_WL_INTERFACE(zwp_fullscreen_shell_v1);
 #undef INTERN_WL_INTERFACE
     template <class T>
     concept wl_client_t = std::same_as<decltype (wl_interface_ptr<T>), wl_interface const *const>;
@@ -137,6 +261,12 @@ inline namespace wayland_client_helper
             else if constexpr (interface_addr == std::addressof(wl_touch_interface)) {
                 wl_touch_release(ptr);
             }
+            else if constexpr (interface_addr == std::addressof(wp_presentation_interface)) {
+                wp_presentation_destroy(ptr);
+            }
+            else if constexpr (interface_addr == std::addressof(zwp_fullscreen_shell_v1_interface)) {
+                zwp_fullscreen_shell_v1_release(ptr);
+            }
             else {
                 wl_proxy_destroy(reinterpret_cast<wl_proxy*>(ptr));
             }
@@ -144,66 +274,246 @@ inline namespace wayland_client_helper
         return std::unique_ptr<T, decltype (deleter)>(ptr, deleter);
     }
     template <wl_client_t T>
-    using unique_ptr_t = decltype (attach_unique(std::declval<T*>()));
+    using unique_ptr_t = decltype (attach_unique(std::declval<T*>()));
 } // ::wayland_client_helper
 
-[[nodiscard]]
-inline auto create_shm_buffer(wl_shm* shm, size_t cx, size_t cy, uint32_t** pixels) noexcept
--> wl_buffer*
-{
-    // Check the environment
-    std::string_view xdg_runtime_dir = std::getenv("XDG_RUNTIME_DIR");
-    if (xdg_runtime_dir.empty() || !std::filesystem::exists(xdg_runtime_dir)) {
-        std::cerr << "This program requires XDG_RUNTIME_DIR setting..." << std::endl;
-        return nullptr;
+// A wl_shm_pool over one memfd region that only ever grows, with first-fit
+// sub-allocation of buffers out of it. Growing remaps the region, so holders
+// of a block keep its offset and recompute addresses from data.
+struct shm_pool {
+    static constexpr size_t npos = ~size_t(0);
+    static constexpr size_t alignment = 4096;
+    wl_shm_pool* pool = nullptr;
+    int fd = -1;
+    void* data = MAP_FAILED;
+    size_t size = 0;
+    std::vector<std::pair<size_t, size_t>> free; // offset and size of free blocks, sorted and coalesced
+
+    shm_pool() = default;
+    shm_pool(shm_pool const&) = delete;
+    ~shm_pool() noexcept {
+        if (this->pool) wl_shm_pool_destroy(this->pool);
+        if (this->data != MAP_FAILED) munmap(this->data, this->size);
+        if (this->fd != -1) close(this->fd);
     }
-    std::string_view tmp_file_title = "/weston-shared-XXXXXX";
-    if (1024 <= xdg_runtime_dir.size() + tmp_file_title.size()) {
-        std::cerr << "The path of XDG_RUNTIME_DIR is too long..." << std::endl;
-        return nullptr;
+    // Returns the offset of a block of at least bytes, or npos.
+    [[nodiscard]] size_t allocate(size_t bytes) noexcept {
+        bytes = (bytes + alignment - 1) / alignment * alignment;
+        for (int retry = 0; retry < 2; ++retry) {
+            for (auto it = this->free.begin(); it != this->free.end(); ++it) {
+                auto& [offset, size] = *it;
+                if (size < bytes) continue;
+                auto ret = offset;
+                offset += bytes;
+                size -= bytes;
+                if (size == 0) this->free.erase(it);
+                return ret;
+            }
+            if (!this->grow(this->size + bytes)) break;
+        }
+        return npos;
     }
-    char tmp_path[1024] = { };
-    auto p = std::strcat(tmp_path, xdg_runtime_dir.data());
-    std::strcat(p, tmp_file_title.data());
-    int fd = mkostemp(tmp_path, O_CLOEXEC);
-    if (fd >= 0) {
-        unlink(tmp_path);
+    void release(size_t offset, size_t bytes) noexcept {
+        bytes = (bytes + alignment - 1) / alignment * alignment;
+        auto it = std::lower_bound(this->free.begin(), this->free.end(), std::pair{offset, size_t(0)});
+        it = this->free.insert(it, { offset, bytes });
+        if (auto next = std::next(it); next != this->free.end() && it->first + it->second == next->first) {
+            it->second += next->second;
+            this->free.erase(next);
+        }
+        if (it != this->free.begin()) {
+            if (auto prev = std::prev(it); prev->first + prev->second == it->first) {
+                prev->second += it->second;
+                this->free.erase(it);
+            }
+        }
     }
-    else {
-        std::cerr << "mkostemp failed..." << std::endl;
+    // Doubles the region until it holds at least size bytes.
+    [[nodiscard]] bool grow(size_t size) noexcept {
+        if (size <= this->size) return true;
+        size = std::max(size, 2 * this->size);
+        if (std::numeric_limits<int32_t>::max() < size) {
+            std::cerr << "shm pool too large..." << std::endl;
+            return false;
+        }
+        if (ftruncate(this->fd, size) < 0) {
+            std::cerr << "ftruncate failed..." << std::endl;
+            return false;
+        }
+        auto data = this->data == MAP_FAILED
+            ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0)
+            : mremap(this->data, this->size, size, MREMAP_MAYMOVE);
+        if (data == MAP_FAILED) {
+            std::cerr << "mmap failed..." << std::endl;
+            return false;
+        }
+        this->data = data;
+        wl_shm_pool_resize(this->pool, size);
+        this->release(this->size, size - this->size);
+        this->size = size;
+        return true;
+    }
+};
+
+[[nodiscard]]
+inline auto create_shm_pool(wl_shm* shm, size_t size) noexcept
+-> std::unique_ptr<shm_pool>
+{
+    auto ret = std::make_unique<shm_pool>();
+    ret->fd = memfd_create("graphio-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (ret->fd < 0) {
+        std::cerr << "memfd_create failed..." << std::endl;
         return nullptr;
     }
-    if (ftruncate(fd, 4*cx*cy) < 0) {
+    // The compositor cannot be made to fault by shrinking what it maps.
+    fcntl(ret->fd, F_ADD_SEALS, F_SEAL_SHRINK);
+    if (ftruncate(ret->fd, size) < 0) {
         std::cerr << "ftruncate failed..." << std::endl;
-        close(fd);
         return nullptr;
     }
-    auto data = mmap(nullptr, 4*cx*cy, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (data == MAP_FAILED) {
+    ret->data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, ret->fd, 0);
+    if (ret->data == MAP_FAILED) {
         std::cerr << "mmap failed..." << std::endl;
-        close(fd);
         return nullptr;
     }
-    *pixels = reinterpret_cast<uint32_t*>(data);
-    return wl_shm_pool_create_buffer(attach_unique(wl_shm_create_pool(shm, fd, 4*cx*cy)).get(),
-                                     0,
-                                     cx, cy,
-                                     cx * 4,
-                                     WL_SHM_FORMAT_ARGB8888);
+    ret->size = size;
+    ret->free.push_back({ 0, size });
+    ret->pool = wl_shm_create_pool(shm, ret->fd, size);
+    if (!ret->pool) {
+        std::cerr << "wl_shm_create_pool failed..." << std::endl;
+        return nullptr;
+    }
+    return ret;
 }
 
-void rendering(sycl::queue& que,
-               uint32_t* pixels,
-               sycl::range<2> dim,
-               std::vector<std::complex<double>> const& vertices) noexcept;
+// N buffers of the current surface size in one wl_shm format. A resize
+// replaces them at once; the ones the compositor still holds are retired and
+// their blocks go back to the pool when it releases them.
+template <size_t N>
+struct shm_swapchain {
+    struct slot {
+        shm_swapchain* chain = nullptr;
+        wl_buffer* buffer = nullptr;
+        size_t offset = 0;
+        size_t size = 0;
+        bool busy = false;
+        bool retired = false;
+        std::vector<rect> damage; // changed since this buffer was last drawn
+
+        [[nodiscard]] void* pixels() const noexcept {
+            return reinterpret_cast<char*>(this->chain->pool->data) + this->offset;
+        }
+    };
+    static constexpr wl_buffer_listener listener {
+        .release = [](void* data, wl_buffer*) noexcept {
+            auto slot = reinterpret_cast<struct slot*>(data);
+            slot->busy = false;
+            if (slot->retired) slot->chain->reclaim(slot);
+        },
+    };
+    std::unique_ptr<shm_pool> pool;
+    std::array<slot, N> slots;
+    std::list<slot> retired;
+    uint32_t format = WL_SHM_FORMAT_ARGB8888;
+    int32_t bytes_per_pixel = 4;
+    int32_t cx = 0;
+    int32_t cy = 0;
+
+    shm_swapchain() = default;
+    shm_swapchain(shm_swapchain const&) = delete;
+    ~shm_swapchain() noexcept {
+        for (auto& slot : this->slots) {
+            if (slot.buffer) wl_buffer_destroy(slot.buffer);
+        }
+        for (auto& slot : this->retired) {
+            wl_buffer_destroy(slot.buffer);
+        }
+    }
+    // Rows are padded to whole 32-bit words; see row_pitch().
+    [[nodiscard]] int32_t stride() const noexcept { return (this->cx * this->bytes_per_pixel + 3) / 4 * 4; }
+    [[nodiscard]] size_t buffer_size() const noexcept { return size_t(this->stride()) * this->cy; }
 
-void windowing(wl_display* display, wl_registry* registry, auto const& globals) noexcept {
-    constexpr int32_t cx = 1024;
-    constexpr int32_t cy =  768;
-    wl_compositor* compositor;
-    wl_shell* shell;
-    wl_seat* seat;
-    wl_shm* shm;
+    // Returns a buffer the compositor has released, or nullptr if all of them are in flight.
+    [[nodiscard]] slot* acquire() noexcept {
+        auto found = std::find_if(this->slots.begin(), this->slots.end(), [](auto const& slot) noexcept {
+            return !slot.busy;
+        });
+        return found == this->slots.end() ? nullptr : std::addressof(*found);
+    }
+    // Recreates the buffers at cx x cy; a no-op when the size is unchanged.
+    [[nodiscard]] bool resize(int32_t cx, int32_t cy) noexcept {
+        if (cx == this->cx && cy == this->cy) return true;
+        for (auto& slot : this->slots) {
+            if (!slot.buffer) continue;
+            if (slot.busy) {
+                auto& retired = this->retired.emplace_back(std::move(slot));
+                retired.retired = true;
+                wl_buffer_set_user_data(retired.buffer, &retired);
+            }
+            else {
+                wl_buffer_destroy(slot.buffer);
+                this->pool->release(slot.offset, slot.size);
+            }
+            slot = {};
+        }
+        this->cx = cx;
+        this->cy = cy;
+        for (auto& slot : this->slots) {
+            slot.chain = this;
+            slot.size = this->buffer_size();
+            slot.offset = this->pool->allocate(slot.size);
+            if (slot.offset == shm_pool::npos) return false;
+            slot.damage.push_back({ 0, 0, cx, cy });
+            slot.buffer = wl_shm_pool_create_buffer(this->pool->pool,
+                                                    slot.offset,
+                                                    cx, cy,
+                                                    this->stride(),
+                                                    this->format);
+            if (!slot.buffer || wl_buffer_add_listener(slot.buffer, &listener, &slot)) {
+                std::cerr << "wl_shm_pool_create_buffer failed..." << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    // Returns the block of a retired buffer once the compositor is done with it.
+    void reclaim(slot* retired) noexcept {
+        auto found = std::find_if(this->retired.begin(), this->retired.end(), [retired](auto const& slot) noexcept {
+            return std::addressof(slot) == retired;
+        });
+        if (found == this->retired.end()) return;
+        wl_buffer_destroy(found->buffer);
+        this->pool->release(found->offset, found->size);
+        this->retired.erase(found);
+    }
+};
+
+template <size_t N = 3>
+[[nodiscard]]
+inline auto create_shm_swapchain(wl_shm* shm, int32_t cx, int32_t cy, uint32_t format, int32_t bytes_per_pixel) noexcept
+-> std::unique_ptr<shm_swapchain<N>>
+{
+    auto chain = std::make_unique<shm_swapchain<N>>();
+    chain->format = format;
+    chain->bytes_per_pixel = bytes_per_pixel;
+    auto stride = size_t(cx * bytes_per_pixel + 3) / 4 * 4;
+    auto bytes = (stride * cy + shm_pool::alignment - 1) / shm_pool::alignment * shm_pool::alignment;
+    chain->pool = create_shm_pool(shm, N * bytes);
+    if (!chain->pool) {
+        std::cerr << "create_shm_pool failed..." << std::endl;
+        return nullptr;
+    }
+    if (!chain->resize(cx, cy)) return nullptr;
+    return chain;
+}
+
+[[nodiscard]] bool windowing(wl_display* display, wl_registry* registry, auto const& globals) noexcept {
+    wl_compositor* compositor = nullptr;
+    wl_shell* shell = nullptr;
+    zwp_fullscreen_shell_v1* fullscreen = nullptr;
+    wl_seat* seat = nullptr;
+    wl_shm* shm = nullptr;
+    wp_presentation* presentation = nullptr;
     for (auto const& item : globals) {
         auto const& [name, interface, version] = item;
         if (interface == wl_compositor_interface.name) {
@@ -230,15 +540,45 @@ void windowing(wl_display* display, wl_registry* registry, auto const& globals)
                                                              &wl_shm_interface,
                                                              version));
         }
+        // Only used where there is no wl_shell, as on a headless Weston.
+        else if (interface == zwp_fullscreen_shell_v1_interface.name) {
+            fullscreen = reinterpret_cast<zwp_fullscreen_shell_v1*>(wl_registry_bind(registry,
+                                                                                     name,
+                                                                                     &zwp_fullscreen_shell_v1_interface,
+                                                                                     1));
+        }
+        // GRAPHIO_LATENCY=1 asks for presentation feedback on every frame and
+        // prints latency histograms on exit.
+        else if (interface == wp_presentation_interface.name && !environment("GRAPHIO_LATENCY").empty()) {
+            presentation = reinterpret_cast<wp_presentation*>(wl_registry_bind(registry,
+                                                                               name,
+                                                                               &wp_presentation_interface,
+                                                                               1));
+        }
+    }
+    // Listening before the first roundtrip, which carries clock_id.
+    latency_meter meter{presentation};
+    // GRAPHIO_REPLAY=<file> plays back a log recorded with GRAPHIO_RECORD
+    // instead of waiting for input, and quits once the frames it caused have
+    // been presented; it needs no seat.
+    std::optional<input_log> replay;
+    if (auto path = environment("GRAPHIO_REPLAY"); !path.empty()) {
+        replay = read_input_log(path.data());
+        if (!replay) return false;
     }
-    if (!compositor || !shell || !seat || !shm) {
+    if (!compositor || !(shell || fullscreen) || !(seat || replay) || !shm) {
         std::cerr << "Some required globals are missing..." << std::endl;
-        return ;
+        return false;
+    }
+    if (!environment("GRAPHIO_LATENCY").empty() && !presentation) {
+        std::cerr << "No wp_presentation, latency is not measured..." << std::endl;
     }
     auto compositor_ptr = attach_unique(compositor);
     auto shell_ptr = attach_unique(shell);
+    auto fullscreen_ptr = attach_unique(fullscreen);
     auto seat_ptr = attach_unique(seat);
     auto shm_ptr = attach_unique(shm);
+    auto presentation_ptr = attach_unique(presentation);
     std::vector<uint32_t> formats;
     wl_shm_listener shm_listener {
         .format = [](void* data, auto, uint32_t format) noexcept {
@@ -247,7 +587,7 @@ void windowing(wl_display* display, wl_registry* registry, auto const& globals)
     };
     if (wl_shm_add_listener(shm, &shm_listener, &formats)) {
         std::cerr << "wl_shm_add_listener failed..." << std::endl;
-        return ;
+        return false;
     }
     uint32_t seat_capability = 0;
     wl_seat_listener seat_listener {
@@ -257,103 +597,106 @@ void windowing(wl_display* display, wl_registry* registry, auto const& globals)
         .name = [](auto, auto, char const* name) noexcept {
         }
     };
-    if (wl_seat_add_listener(seat, &seat_listener, &seat_capability)) {
+    if (seat && wl_seat_add_listener(seat, &seat_listener, &seat_capability)) {
         std::cerr << "wl_seat_add_listener failed..." << std::endl;
-        return ;
+        return false;
     }
     wl_display_roundtrip(display);
-    if (std::none_of(formats.begin(), formats.end(), [](auto item) noexcept {
-        return item == WL_SHM_FORMAT_ARGB8888;
-    }))
-    {
-        std::cerr << "WL_SHM_FORMAT_ARGB8888 required..." << std::endl;
-        return ;
+    // xrgb8888, unless GRAPHIO_PIXELS=argb8888|xrgb8888|abgr2101010|rgb565
+    // names another advertised format; see any_pixel_format. The kernels
+    // writing pixels are specialised on it.
+    auto pixel_format = make_pixel_format(environment("GRAPHIO_PIXELS"), formats);
+    if (!pixel_format) {
+        std::cerr << "No supported wl_shm format..." << std::endl;
+        return false;
     }
-    if (!(seat_capability & WL_SEAT_CAPABILITY_POINTER) ||
-        !(seat_capability & WL_SEAT_CAPABILITY_KEYBOARD))
+    auto [shm_format, bytes_per_pixel] = std::visit([](auto format) noexcept {
+        using P = decltype (format);
+        return std::pair{ P::shm_format, int32_t(sizeof (typename P::pixel)) };
+    }, *pixel_format);
+    if (!replay &&
+        (!(seat_capability & WL_SEAT_CAPABILITY_POINTER) ||
+         !(seat_capability & WL_SEAT_CAPABILITY_KEYBOARD)))
     {
         std::cerr << "Keyboad and pointers required..." << std::endl;
-        return ;
+        return false;
     }
-    auto keyboard = wl_seat_get_keyboard(seat);
-    if (!keyboard) {
+    auto keyboard = (seat_capability & WL_SEAT_CAPABILITY_KEYBOARD) ? wl_seat_get_keyboard(seat) : nullptr;
+    if (!keyboard && (seat_capability & WL_SEAT_CAPABILITY_KEYBOARD)) {
         std::cerr << "wl_seat_get_keyboard failed..." << std::endl;
-        return ;
+        return false;
     }
     auto keyboard_ptr = attach_unique(keyboard);
-    bool quit = false;
+    scene scene;
+    // Where the input listeners deliver to.
+    struct {
+        struct scene* scene;
+        latency_meter* meter;
+    } sink{ &scene, &meter };
     wl_keyboard_listener keyboard_listener {
         .keymap = [](auto...) noexcept { },
         .enter = [](auto...) noexcept { },
         .leave = [](auto...) noexcept { },
-        .key = [](auto data, auto, auto serial, auto time, auto key, auto state) noexcept {
-            if (state == 0 && (key == 1 || key == 16)) {
-                *reinterpret_cast<bool*>(data) = true;
+        .key = [](auto data, auto, auto serial, uint32_t time, uint32_t key, uint32_t state) noexcept {
+            auto sink = reinterpret_cast<decltype (sink)*>(data);
+            auto scene = sink->scene;
+            sink->meter->input(time);
+            auto curve = scene->curve;
+            scene->apply({ .kind = input_kind::key, .state = uint16_t(state), .code = key });
+            if (scene->curve != curve) {
+                std::cout << "Tone curve: " << tone_curve_names[static_cast<size_t>(scene->curve)] << std::endl;
             }
         },
         .modifiers = [](auto...) noexcept { },
         .repeat_info = [](auto...) noexcept { },
     };
-    if (wl_keyboard_add_listener(keyboard, &keyboard_listener, &quit)) {
+    if (keyboard && wl_keyboard_add_listener(keyboard, &keyboard_listener, &sink)) {
         std::cerr << "wl_keyboard_add_listener failed..." << std::endl;
-        return ;
+        return false;
     }
-    auto pointer = wl_seat_get_pointer(seat);
-    if (!pointer) {
+    auto pointer = (seat_capability & WL_SEAT_CAPABILITY_POINTER) ? wl_seat_get_pointer(seat) : nullptr;
+    if (!pointer && (seat_capability & WL_SEAT_CAPABILITY_POINTER)) {
         std::cerr << "wl_seat_get_pointer failed..." << std::endl;
-        return ;
+        return false;
     }
     auto pointer_ptr = attach_unique(pointer);
-    std::vector<std::complex<double>> vertices{{}};
-    assert(vertices.empty() == false);
     wl_pointer_listener pointer_listener {
         .enter = [](auto...) noexcept { },
         .leave = [](auto...) noexcept { },
-        .motion = [](auto data, auto, auto time, auto x, auto y) noexcept {
-            auto vertices = reinterpret_cast<std::vector<std::complex<double>>*>(data);
-            auto& cursor = vertices->front();
-            cursor = { wl_fixed_to_double(x), wl_fixed_to_double(y) };
+        .motion = [](auto data, auto, uint32_t time, wl_fixed_t x, wl_fixed_t y) noexcept {
+            auto sink = reinterpret_cast<decltype (sink)*>(data);
+            sink->meter->input(time);
+            sink->scene->apply({ .kind = input_kind::motion, .x = x, .y = y });
         },
-        .button = [](auto data, auto, auto, auto, auto button, auto state) /*noexcept*/ {
-            if (button == BTN_RIGHT && state) {
-                constexpr float tau = 2 * std::numbers::pi_v<double>;
-                constexpr float phi = std::numbers::phi_v<double>;
-                auto vertices = reinterpret_cast<std::vector<std::complex<double>>*>(data);
-                auto pt = vertices->front();
-                vertices->push_back(pt);
-                for (int i = 1; i < 64; ++i) {
-                    auto d = std::polar<double>(std::sqrt(i), i*tau*phi);
-                    vertices->push_back(pt + d);
-                }
-                for (int i = 1; i < std::abs(pt); ++i) {
-                    vertices->push_back(std::fmod(phi*i, 1.0) * pt);
-                }
-                for (int i = 1; i < std::abs(std::complex<double>(cx, 0) - pt); ++i) {
-                    vertices->push_back(pt +
-                                        std::fmod(phi*i, 1.0) * (std::complex<double>(cx, 0) - pt));
-                }
-            }
+        .button = [](auto data, auto, auto, uint32_t time, uint32_t button, uint32_t state) /*noexcept*/ {
+            auto sink = reinterpret_cast<decltype (sink)*>(data);
+            sink->meter->input(time);
+            sink->scene->apply({ .kind = input_kind::button, .state = uint16_t(state), .code = button });
+        },
+        .axis = [](auto data, auto, uint32_t time, uint32_t axis, wl_fixed_t value) noexcept {
+            auto sink = reinterpret_cast<decltype (sink)*>(data);
+            sink->meter->input(time);
+            sink->scene->apply({ .kind = input_kind::axis, .code = axis, .x = value });
         },
-        .axis = [](auto...) noexcept { },
         .frame = [](auto...) noexcept { },
         .axis_source = [](auto...) noexcept { },
         .axis_stop = [](auto...) noexcept { },
         .axis_discrete = [](auto...) noexcept { },
     };
-    if (wl_pointer_add_listener(pointer, &pointer_listener, &vertices)) {
+    if (pointer && wl_pointer_add_listener(pointer, &pointer_listener, &sink)) {
         std::cerr << "wl_pointer_add_listener failed..." << std::endl;
-        return ;
+        return false;
     }
     auto surface = wl_compositor_create_surface(compositor);
     if (!surface) {
         std::cerr << "wl_compositor_create_surface failed..." << std::endl;
-        return ;
+        return false;
     }
     auto surface_ptr = attach_unique(surface);
-    auto shell_surface = wl_shell_get_shell_surface(shell, surface);
-    if (!shell_surface) {
-        std::cerr << wl_shell_get_shell_surface(shell, surface) << std::endl;
-        return ;
+    auto shell_surface = shell ? wl_shell_get_shell_surface(shell, surface) : nullptr;
+    if (shell && !shell_surface) {
+        std::cerr << "wl_shell_get_shell_surface failed..." << std::endl;
+        return false;
     }
     auto shell_surface_ptr = attach_unique(shell_surface);
     wl_shell_surface_listener shellsurf_listener {
@@ -361,37 +704,306 @@ void windowing(wl_display* display, wl_registry* registry, auto const& globals)
             wl_shell_surface_pong(shellsurf, serial);
             std::cout << "Pinged and ponged." << std::endl;
         },
-        .configure = [](auto...) noexcept {
-            std::cout << "Configuring... (not support yet)" << std::endl;
+        // Only recorded here; the buffers follow when the next frame is drawn,
+        // so a burst of configures during an interactive resize costs one
+        // reallocation at most.
+        .configure = [](void* data, auto, uint32_t, int32_t width, int32_t height) noexcept {
+            reinterpret_cast<struct scene*>(data)->apply({ .kind = input_kind::configure, .x = width, .y = height });
         },
         .popup_done = [](auto...) noexcept {
             std::cerr << "Popup done." << std::endl;
         },
     };
-    if (wl_shell_surface_add_listener(shell_surface, &shellsurf_listener, nullptr)) {
+    if (shell_surface && wl_shell_surface_add_listener(shell_surface, &shellsurf_listener, &scene)) {
         std::cerr << "wl_shell_surface_add_listener failed..." << std::endl;
-        return ;
-    }
-    uint32_t* pixels = nullptr;
-    auto buffer = create_shm_buffer(shm, cx, cy, &pixels);
-    if (!buffer) {
-        std::cerr << "create_shm_buffer failed..." << std::endl;
-        return ;
-    }
-    auto buffer_ptr = attach_unique(buffer);
-    wl_shell_surface_set_toplevel(shell_surface);
-    sycl::queue que;
-    do {
-        if (quit) break;
-        rendering(que, pixels, {cy, cx}, vertices);
-        wl_surface_damage(surface, 0, 0, cx, cy);
-        wl_surface_attach(surface, buffer, 0, 0);
-        wl_surface_commit(surface);
-        wl_display_flush(display);
-    } while (wl_display_dispatch(display) != -1);
+        return false;
+    }
+    auto swapchain = create_shm_swapchain(shm, scene.cx, scene.cy, shm_format, bytes_per_pixel);
+    if (!swapchain) {
+        std::cerr << "create_shm_swapchain failed..." << std::endl;
+        return false;
+    }
+    if (shell_surface) {
+        wl_shell_surface_set_toplevel(shell_surface);
+    }
+    else {
+        zwp_fullscreen_shell_v1_present_surface(fullscreen, surface, ZWP_FULLSCREEN_SHELL_V1_PRESENT_METHOD_DEFAULT, nullptr);
+    }
+    scene.invalidate({ 0, 0, scene.cx, scene.cy });
+    // Pending frame callback; a new frame is only drawn once the compositor
+    // has signalled that the previous one was presented.
+    wl_callback* frame_callback = nullptr;
+    wl_callback_listener frame_listener {
+        .done = [](void* data, wl_callback* callback, uint32_t) noexcept {
+            wl_callback_destroy(callback);
+            *reinterpret_cast<wl_callback**>(data) = nullptr;
+        },
+    };
+    // GRAPHIO_TRACE=<file.json> records per-stage timings, prints a rolling
+    // summary to stdout and writes a Chrome/Perfetto trace on exit.
+    frame_trace trace{environment("GRAPHIO_TRACE").data()};
+    // GRAPHIO_BANDS=numa|<n> renders the frame in horizontal bands, one per
+    // NUMA domain of the device or n of them, each on a queue of its own.
+    auto queues = make_queues(sycl::device{sycl::default_selector_v},
+                              environment("GRAPHIO_BANDS"),
+                              trace.enabled()
+                              ? sycl::property_list{sycl::property::queue::in_order{},
+                                                    sycl::property::queue::enable_profiling{}}
+                              : sycl::property_list{sycl::property::queue::in_order{}});
+    auto& que = queues.front();
+    // What the bands render from or into has to be reachable from all of
+    // their sub-devices.
+    auto kind = queues.size() > 1 ? sycl::usm::alloc::shared : sycl::usm::alloc::device;
+    // Double precision only where the device does it natively; fp32 halves the
+    // store and the splat arithmetic otherwise. GRAPHIO_VERTICES overrides it.
+    std::string_view format = environment("GRAPHIO_VERTICES");
+    if (format.empty()) {
+        format = que.get_device().has(sycl::aspect::fp64) ? fp64::name : fp32::name;
+    }
+    auto store = make_vertex_store(format, que, kind);
+    tile_bins bins{que, sycl::range<2>(scene.cy, scene.cx)};
+    if (!bins) {
+        std::cerr << "tile_bins allocation failed..." << std::endl;
+        return false;
+    }
+    std::vector<std::unique_ptr<render_band>> bands;
+    for (size_t i = 1; i < queues.size(); ++i) {
+        bands.push_back(std::make_unique<render_band>(queues[i], sycl::range<2>(scene.cy, scene.cx)));
+        if (!bands.back()->bins) {
+            std::cerr << "tile_bins allocation failed..." << std::endl;
+            return false;
+        }
+    }
+    trace.reserve(bands.size());
+    // Splat weights accumulate into density, which persists across frames;
+    // only damaged tiles are re-accumulated, and a change of tone curve only
+    // maps it again. GRAPHIO_TONE=linear|log|equalized picks the initial
+    // curve, the T key cycles through them.
+    usm_unique_ptr<uint32_t> density{nullptr, usm_deleter{&que}};
+    tone_map tones{que};
+    if (!tones) {
+        std::cerr << "tone_map allocation failed..." << std::endl;
+        return false;
+    }
+    if (auto name = environment("GRAPHIO_TONE"); !name.empty()) scene.curve = parse_tone_curve(name);
+    // When kernels can dereference ordinary host memory they draw straight into
+    // the shm buffers; otherwise they draw into a device framebuffer that is
+    // copied out once per frame. Both grow with the surface but never shrink.
+    // The framebuffer has room for a frame of the widest pixel format.
+    usm_unique_ptr<uint32_t> framebuffer{nullptr, usm_deleter{&que}};
+    size_t framebuffer_capacity = 0;
+    bool direct = que.get_device().has(sycl::aspect::usm_system_allocations);
+    // GRAPHIO_POINTS=<file> draws a recorded point cloud (interleaved x, y
+    // doubles) underneath. The points in view are streamed into a layer of
+    // splat sums in the background, again whenever the surface outgrows it or
+    // the view moves; frames are drawn without the layer meanwhile. A stream
+    // goes into next, which takes the place of layer once it is complete.
+    std::unique_ptr<point_file> points;
+    auto points_path = environment("GRAPHIO_POINTS");
+    if (!points_path.empty()) {
+        points = map_point_file(points_path.data(), que);
+        if (!points) return false;
+    }
+    splat_layer layer{que, kind};
+    splat_layer next{que, kind};
+    bool fresh = false; // next is complete and not yet drawn
+    // GRAPHIO_RECORD=<file> logs the session, every input event, and the
+    // point each frame takes its snapshot of the scene, for graphio-replay.
+    auto config = session_config{
+        .vertices = std::string(format),
+        .tone = std::string(tone_curve_names[static_cast<size_t>(scene.curve)]),
+        .pixels = std::visit([](auto format) noexcept { return std::string(decltype (format)::name); }, *pixel_format),
+        .points = std::string(points_path),
+    };
+    input_recorder recorder{environment("GRAPHIO_RECORD").data(), config};
+    if (recorder) scene.recorder = &recorder;
+    // Input keeps being dispatched while a frame is on the device or waiting
+    // for the compositor; whatever arrives in the meantime goes into the next
+    // frame.
+    executor ex{display, &trace};
+    if (!ex) {
+        std::cerr << "eventfd failed..." << std::endl;
+        return false;
+    }
+    // Streams the points into next for a frame of dim under view, in the
+    // vertex format of store, a step per completion of the queue. Gives up
+    // as soon as the view moves on.
+    auto streaming = [&](auto const& store, sycl::range<2> dim, viewport view) -> delay<bool> {
+        using format = typename std::remove_cvref_t<decltype (store)>::format;
+        point_stream<format> stream{que, *points, next, dim, view};
+        if (!stream) co_return false;
+        while (stream.step(que)) {
+            co_await ex.completion(que);
+            if (scene.quit || scene.view != view) break;
+        }
+        co_return true;
+    };
+    auto stale = [&](splat_layer const& l) noexcept {
+        return l.view != scene.view || l.dim[0] < size_t(scene.cy) || l.dim[1] < size_t(scene.cx);
+    };
+    auto layering = [&]() -> delay<bool> {
+        if (!points) co_return true;
+        while (!scene.quit) {
+            co_await ex.until([&]() noexcept { return scene.quit || stale(fresh ? next : layer); });
+            if (scene.quit) break;
+            fresh = false;
+            auto extent = sycl::range<2>(std::max(layer.dim[0], size_t(scene.cy)),
+                                         std::max(layer.dim[1], size_t(scene.cx)));
+            auto streamed = trace.now();
+            auto ok = co_await std::visit([&](auto const& store) noexcept {
+                return streaming(store, extent, scene.view);
+            }, store);
+            if (!ok) co_return false;
+            if (stale(next)) continue;
+            trace.host("stream", streamed);
+            fresh = true;
+            scene.reshape({ 0, 0, scene.cx, scene.cy });
+        }
+        co_return true;
+    };
+    auto drawing = [&]() -> delay<bool> {
+        while (!scene.quit) {
+            co_await ex.until([&]() noexcept { return scene.quit || (scene.dirty && !frame_callback); });
+            if (scene.quit) break;
+            // Whatever the frame draws is only taken from the scene once a
+            // buffer is ours, so that input arriving meanwhile makes it in.
+            if (scene.damage.empty() && scene.cursor == scene.crosshair && tones.curve == scene.curve) {
+                scene.dirty = false;
+                continue;
+            }
+            shm_swapchain<3>::slot* slot = nullptr;
+            co_await ex.until([&]() noexcept { return scene.quit || (slot = swapchain->acquire()); });
+            if (scene.quit) break;
+            // The size too, including configures that came while waiting.
+            // New buffers and new density hold nothing yet, so all of the
+            // frame is drawn into them.
+            auto cx = scene.cx;
+            auto cy = scene.cy;
+            auto dim = sycl::range<2>(cy, cx);
+            if (swapchain->cx != cx || swapchain->cy != cy) {
+                if (!swapchain->resize(cx, cy)) co_return false;
+                slot = swapchain->acquire();
+                scene.reshape({ 0, 0, cx, cy });
+            }
+            if (framebuffer_capacity < size_t(cx) * cy) {
+                framebuffer_capacity = std::max(size_t(cx) * cy, 2 * framebuffer_capacity);
+                density = malloc_unique<uint32_t>(framebuffer_capacity, que, kind);
+                if (!direct) framebuffer = malloc_device_unique<uint32_t>(framebuffer_capacity, que);
+                if (!density || (!direct && !framebuffer)) {
+                    std::cerr << "sycl::malloc failed..." << std::endl;
+                    co_return false;
+                }
+                first_touch(bands, density.get(), dim);
+                scene.reshape({ 0, 0, cx, cy });
+            }
+            // No frame is in flight, so nothing reads the layer swapped out.
+            if (fresh) {
+                std::swap(layer, next);
+                fresh = false;
+            }
+            auto under = layer.view == scene.view ? &layer : nullptr;
+            scene.apply({ .kind = input_kind::frame, .state = uint16_t(under != nullptr), .x = cx, .y = cy });
+            meter.snapshot();
+            std::vector<rect> damage;
+            auto present = [&](std::vector<rect> const& drawn, std::complex<double> cursor, bool remapped) noexcept {
+                // Each buffer may be several frames behind; catch it up on
+                // everything that changed since it was last drawn.
+                for (auto& other : swapchain->slots) {
+                    if (remapped) other.damage = drawn;
+                    else for (auto r : drawn) accumulate_damage(other.damage, r);
+                }
+                damage = drawn;
+                std::visit([&](auto format) noexcept {
+                    using P = decltype (format);
+                    using pixel = typename P::pixel;
+                    auto pitch = row_pitch<P>(cx);
+                    auto pixels = reinterpret_cast<pixel*>(slot->pixels());
+                    auto staged = reinterpret_cast<pixel*>(framebuffer.get());
+                    trace.device("tone", framebuffer
+                                 ? tone_mapping<P>(que, staged, pitch, dim, density.get(), tones, cursor, damage)
+                                 : tone_mapping<P>(que, pixels, pitch, dim, density.get(), tones, cursor, slot->damage));
+                    if (framebuffer) {
+                        trace.device("present", presenting<P>(que, staged, pixels, pitch, dim, slot->damage));
+                    }
+                }, *pixel_format);
+                return true;
+            };
+            auto completion = [&](sycl::queue& q) noexcept { return ex.completion(q); };
+            auto drawn = co_await draw_frame(renderer{ &que, &bands, &store, &bins, &tones, under, &trace },
+                                             scene, density.get(), dim, completion, present);
+            if (!drawn) co_return false;
+            slot->damage.clear();
+            auto committed = trace.now();
+            frame_callback = wl_surface_frame(surface);
+            wl_callback_add_listener(frame_callback, &frame_listener, &frame_callback);
+            for (auto r : damage) {
+                wl_surface_damage_buffer(surface, r.x, r.y, r.cx, r.cy);
+            }
+            wl_surface_attach(surface, slot->buffer, 0, 0);
+            meter.commit(surface);
+            wl_surface_commit(surface);
+            slot->busy = true;
+            trace.host("commit", committed);
+            trace.end_frame();
+        }
+        co_return true;
+    };
+    // Replayed events are applied at their recorded pace and stamped as they
+    // go, so that their latency is measured like that of live ones.
+    auto feeding = [&]() -> delay<bool> {
+        if (!replay) co_return true;
+        auto started = executor::clock::now();
+        for (auto const& ev : replay->events) {
+            if (ev.kind == input_kind::configure || ev.kind == input_kind::frame) continue;
+            co_await ex.at(started + std::chrono::nanoseconds(ev.time), [&]() noexcept { return scene.quit; });
+            if (scene.quit) co_return true;
+            meter.input(meter.now_ms());
+            scene.apply(ev);
+        }
+        co_await ex.until([&]() noexcept { return scene.quit || (!scene.dirty && meter.frames.empty()); });
+        scene.quit = true;
+        co_return true;
+    };
+    // A frame that fails to draw, or a stream that fails, ends the session;
+    // replayed input would otherwise keep waiting for frames that never come.
+    auto session = [&]() -> delay<bool> {
+        auto ok = co_await drawing();
+        if (!ok) scene.quit = true;
+        co_return ok;
+    };
+    auto streams = [&]() -> delay<bool> {
+        auto ok = co_await layering();
+        if (!ok) scene.quit = true;
+        co_return ok;
+    };
+    auto task = session();
+    auto feed = feeding();
+    auto restream = streams();
+    auto ok = ex.run(task, feed, restream);
+    // A lost display leaves the frame in flight: kernels still using the
+    // buffers below and host tasks about to touch the suspended coroutines.
+    for (auto& q : queues) q.wait();
+    if (!ok) {
+        std::cerr << "Lost the display connection..." << std::endl;
+    }
+    else if (!task.result()) {
+        std::cerr << "Drawing failed..." << std::endl;
+        ok = false;
+    }
+    else if (!restream.result()) {
+        std::cerr << "Streaming failed..." << std::endl;
+        ok = false;
+    }
+    meter.report(std::cout);
+    if (frame_callback) wl_callback_destroy(frame_callback);
+    if (trace.enabled() && trace.write()) {
+        std::cout << "Trace written to " << trace.path << std::endl;
+    }
+    return ok;
 }
 
 int main() {
+    int status = 0;
     if (auto display = attach_unique(wl_display_connect(nullptr))) {
         if (auto registry = attach_unique(wl_display_get_registry(display.get()))) {
             try {
@@ -412,78 +1024,13 @@ int main() {
                 };
                 wl_registry_add_listener(registry.get(), &listener, &globals);
                 wl_display_roundtrip(display.get());
-                windowing(display.get(), registry.get(), globals);
+                if (!windowing(display.get(), registry.get(), globals)) status = 1;
             }
             catch (std::exception& ex) {
                 std::cerr << "Exception: " << ex.what() << std::endl;
+                status = 1;
             }
         }
     }
-    return 0;
-}
-
-inline uint32_t& assign(uint32_t& lhs, auto a, auto r, auto g, auto b) noexcept {
-    uint32_t ret = 0;
-    int32_t rhs[] = {
-        static_cast<int32_t>(b),
-        static_cast<int32_t>(g),
-        static_cast<int32_t>(r),
-        static_cast<int32_t>(a),
-    };
-    for (int i = 0; i < 4; ++i) {
-        int32_t x = (lhs & (0xff << (i*8))) >> (i*8);
-        x = std::min<int>(0xff, x + rhs[i]);
-        ret |= (x << (i*8));
-    }
-    return lhs = ret;
-}
-
-void rendering(sycl::queue& que,
-               uint32_t* pixels,
-               sycl::range<2> dim,
-               std::vector<std::complex<double>> const& vertices) noexcept
-{
-    auto pix = sycl::buffer{pixels, dim};
-    auto cur = vertices.front();
-    auto pts = sycl::buffer<std::complex<double>>{&vertices.front(), vertices.size()};
-    que.submit([&](sycl::handler& h) noexcept {
-        auto a = pix.get_access<sycl::access::mode::write>(h);
-        h.parallel_for(dim, [=](auto idx) noexcept {
-            if (cur.real() == idx[1] || cur.imag() == idx[0]) {
-                a[idx] = 0xccffffff;
-            }
-            else {
-                a[idx] = 0xcc000000;
-            }
-        });
-    });
-    que.submit([&](sycl::handler& h) noexcept {
-        auto apx = pix.get_access<sycl::access::mode::read_write>(h);
-        auto apt = pts.get_access<sycl::access::mode::read>(h);
-        h.parallel_for(vertices.size(), [=](auto idx) noexcept {
-            auto pt = apt[idx];
-            auto pq = std::complex<double>{
-                std::floor(pt.real()),
-                std::floor(pt.imag()),
-            };
-            auto pr = std::complex<double>{
-                std::fmod(pt.real(), 1.0),
-                std::fmod(pt.imag(), 1.0),
-            };
-            auto xr = pr.real();
-            auto yr = pr.imag();
-            unsigned a = 255 * (1 - xr) * (1 - yr);
-            unsigned b = 255 * (1 - xr) * yr;
-            unsigned c = 255 * xr * (1 - yr);
-            unsigned d = 255 * xr * yr;
-            assign(apx[{(unsigned) pq.imag()+0, (unsigned) pq.real()+0}], 0, a, a, a);
-            assign(apx[{(unsigned) pq.imag()+1, (unsigned) pq.real()+0}], 0, b, b, b);
-            assign(apx[{(unsigned) pq.imag()+0, (unsigned) pq.real()+1}], 0, c, c, c);
-            assign(apx[{(unsigned) pq.imag()+1, (unsigned) pq.real()+1}], 0, d, d, d);
-            // apx[{(unsigned) pq.imag()+0, (unsigned) pq.real()+0}] |= 0xff000000 | a << 16 | a << 8;
-            // apx[{(unsigned) pq.imag()+1, (unsigned) pq.real()+0}] |= 0xff000000 | b << 16 | b << 8;
-            // apx[{(unsigned) pq.imag()+0, (unsigned) pq.real()+1}] |= 0xff000000 | c << 16 | c << 8;
-            // apx[{(unsigned) pq.imag()+1, (unsigned) pq.real()+1}] |= 0xff000000 | d << 16 | d << 8;
-        });
-    });
+    return status;
 }
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What graphio-bench and graphio-replay report about the frames they draw.
+inline namespace frame_metrics
+{
+    // Samples of a duration, printed as a JSON object of their mean and
+    // nearest-rank percentiles.
+    struct stats {
+        std::vector<double> samples; // milliseconds
+        void print(std::ostream& output) {
+            if (this->samples.empty()) {
+                output << "null";
+                return ;
+            }
+            std::ranges::sort(this->samples);
+            // Nearest-rank percentile.
+            auto rank = [this](double q) noexcept {
+                auto n = this->samples.size();
+                return this->samples[std::clamp<size_t>(std::ceil(q * n), 1, n) - 1];
+            };
+            auto mean = std::accumulate(this->samples.begin(), this->samples.end(), 0.0) / this->samples.size();
+            output << "{\"mean\":" << mean << ",\"p50\":" << rank(0.5) << ",\"p99\":" << rank(0.99) << '}';
+        }
+    };
+
+    // FNV-1a over count pixels, a byte at a time from the lowest, continuing
+    // from hash; frames are chained by passing the last result back in.
+    constexpr uint64_t checksum_basis = 0xcbf29ce484222325;
+    inline uint64_t checksum(uint64_t hash, uint32_t const* pixels, size_t count) noexcept {
+        for (size_t k = 0; k < count; ++k) {
+            for (int i = 0; i < 4; ++i) {
+                hash = (hash ^ ((pixels[k] >> (i*8)) & 0xff)) * 0x100000001b3;
+            }
+        }
+        return hash;
+    }
+} // ::frame_metrics
@@ -0,0 +1,1626 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <concepts>
+#include <memory>
+#include <vector>
+#include <array>
+#include <variant>
+#include <utility>
+#include <optional>
+#include <limits>
+#include <string_view>
+#include <complex>
+#include <numbers>
+#include <numeric>
+#include <ranges>
+#include <span>
+#include <cmath>
+#include <cstdint>
+#include <climits>
+
+#include <CL/sycl.hpp>
+
+struct rect {
+    int32_t x, y, cx, cy;
+    [[nodiscard]] bool empty() const noexcept { return cx <= 0 || cy <= 0; }
+    [[nodiscard]] bool contains(int32_t px, int32_t py) const noexcept {
+        return x <= px && px < x + cx && y <= py && py < y + cy;
+    }
+};
+
+[[nodiscard]] inline rect united(rect a, rect b) noexcept {
+    if (a.empty()) return b;
+    if (b.empty()) return a;
+    auto x = std::min(a.x, b.x);
+    auto y = std::min(a.y, b.y);
+    return { x, y, std::max(a.x + a.cx, b.x + b.cx) - x, std::max(a.y + a.cy, b.y + b.cy) - y };
+}
+
+[[nodiscard]] inline rect intersected(rect a, rect b) noexcept {
+    auto x = std::max(a.x, b.x);
+    auto y = std::max(a.y, b.y);
+    return { x, y, std::min(a.x + a.cx, b.x + b.cx) - x, std::min(a.y + a.cy, b.y + b.cy) - y };
+}
+
+constexpr size_t max_damage_rects = 16;
+
+// Appends r to a damage list, keeping the list short by merging r into the
+// entry whose area grows the least once the list is full.
+inline void accumulate_damage(std::vector<rect>& damage, rect r) noexcept {
+    if (r.empty()) return;
+    if (damage.size() < max_damage_rects) {
+        damage.push_back(r);
+        return ;
+    }
+    auto growth = [r](rect a) noexcept {
+        auto b = united(a, r);
+        return int64_t(b.cx) * b.cy - int64_t(a.cx) * a.cy;
+    };
+    auto best = std::min_element(damage.begin(), damage.end(), [&](auto a, auto b) noexcept {
+        return growth(a) < growth(b);
+    });
+    *best = united(*best, r);
+}
+
+// Pixels touched by the 2x2 bilinear splats of the given points.
+[[nodiscard]] inline rect footprint(std::ranges::input_range auto const& points) noexcept {
+    rect ret{};
+    for (auto const& pt : points) {
+        ret = united(ret, { static_cast<int32_t>(std::floor(pt.real())),
+                            static_cast<int32_t>(std::floor(pt.imag())),
+                            2, 2 });
+    }
+    return ret;
+}
+
+// World coordinates, those of the vertex store, to surface pixels:
+// (world - origin) * scale.
+struct viewport {
+    std::complex<double> origin;
+    double scale = 1;
+
+    [[nodiscard]] std::complex<double> to_screen(std::complex<double> w) const noexcept {
+        return (w - this->origin) * this->scale;
+    }
+    [[nodiscard]] std::complex<double> to_world(std::complex<double> s) const noexcept {
+        return s / this->scale + this->origin;
+    }
+    // Screen pixels that may show what lies in world rect r.
+    [[nodiscard]] rect to_screen(rect r) const noexcept {
+        if (r.empty()) return r;
+        auto lo = this->to_screen(std::complex<double>(r.x, r.y));
+        auto hi = this->to_screen(std::complex<double>(r.x + r.cx, r.y + r.cy));
+        auto clamp = [](double v) noexcept { return static_cast<int32_t>(std::clamp(v, -0x1p30, 0x1p30)); };
+        auto x = clamp(std::floor(lo.real())) - 1;
+        auto y = clamp(std::floor(lo.imag())) - 1;
+        return { x, y, clamp(std::ceil(hi.real())) + 2 - x, clamp(std::ceil(hi.imag())) + 2 - y };
+    }
+    // Scales by factor, keeping the world point under screen position s in place.
+    void zoom(std::complex<double> s, double factor) noexcept {
+        auto w = this->to_world(s);
+        this->scale = std::clamp(this->scale * factor, 0x1p-10, 0x1p10);
+        this->origin = w - s / this->scale;
+    }
+    void pan(std::complex<double> ds) noexcept {
+        this->origin -= ds / this->scale;
+    }
+    bool operator==(viewport const&) const noexcept = default;
+};
+
+inline namespace usm_helper
+{
+    struct usm_deleter {
+        sycl::queue* que;
+        void operator()(void* ptr) const noexcept { sycl::free(ptr, *this->que); }
+    };
+    template <class T>
+    using usm_unique_ptr = std::unique_ptr<T[], usm_deleter>;
+    template <class T>
+    [[nodiscard]] auto malloc_device_unique(size_t count, sycl::queue& que) noexcept {
+        return usm_unique_ptr<T>(sycl::malloc_device<T>(count, que), usm_deleter{&que});
+    }
+    // Memory of the given kind; device memory belongs to the device of que
+    // alone, while shared memory is reachable from the sub-devices of its
+    // context as well.
+    template <class T>
+    [[nodiscard]] auto malloc_unique(size_t count, sycl::queue& que, sycl::usm::alloc kind) noexcept {
+        return usm_unique_ptr<T>(sycl::malloc<T>(count, que, kind), usm_deleter{&que});
+    }
+} // ::usm_helper
+
+// Integer corner and the four bilinear weights of a vertex's 2x2 splat.
+struct splat_taps {
+    int32_t x, y;
+    unsigned a, b, c, d; // (x, y), (x, y+1), (x+1, y), (x+1, y+1)
+};
+
+template <std::floating_point T>
+inline splat_taps bilinear(T x, T y) noexcept {
+    auto xq = std::floor(x);
+    auto yq = std::floor(y);
+    // Same as fmod(pt, 1) for the usual non-negative coordinates, but stays
+    // within [0, 1) for vertices left of or above the frame.
+    auto xr = x - xq;
+    auto yr = y - yq;
+    return {
+        static_cast<int32_t>(xq),
+        static_cast<int32_t>(yq),
+        static_cast<unsigned>(255 * (1 - xr) * (1 - yr)),
+        static_cast<unsigned>(255 * (1 - xr) * yr),
+        static_cast<unsigned>(255 * xr * (1 - yr)),
+        static_cast<unsigned>(255 * xr * yr),
+    };
+}
+
+// Representations of a vertex coordinate on the device. The store keeps x and
+// y in separate arrays of scalar, and the kernels are specialised on the
+// format. real is the arithmetic the device does on the format's behalf, so
+// nothing touches double unless the format is fp64. to_screen() applies a
+// viewport in the format's own arithmetic, so that the identity view is exact,
+// and clamps what lands far off the surface to a harmless pixel index.
+// Against fp64, fp32 and fixed16 truncate every tap differently by at most
+// one, so a pixel's density may differ by as many splats as reach it.
+inline namespace vertex_formats
+{
+    struct fp64 {
+        using scalar = double;
+        using real = double;
+        static constexpr char const* name = "fp64";
+        static scalar encode(real v) noexcept { return v; }
+        static real decode(scalar v) noexcept { return v; }
+        static scalar to_screen(scalar v, scalar origin, scalar scale) noexcept {
+            return std::clamp((v - origin) * scale, -0x1p24, 0x1p24);
+        }
+        static splat_taps taps(scalar x, scalar y) noexcept { return bilinear(x, y); }
+    };
+    struct fp32 {
+        using scalar = float;
+        using real = float;
+        static constexpr char const* name = "fp32";
+        static scalar encode(real v) noexcept { return v; }
+        static real decode(scalar v) noexcept { return v; }
+        static scalar to_screen(scalar v, scalar origin, scalar scale) noexcept {
+            return std::clamp((v - origin) * scale, -0x1p24f, 0x1p24f);
+        }
+        static splat_taps taps(scalar x, scalar y) noexcept { return bilinear(x, y); }
+    };
+    // 16.16 fixed point; covers +-32k pixels of world space, and saturates
+    // beyond. The host encodes from double, so that coordinates keep all 16
+    // fractional bits however far they are from the origin; the device, which
+    // only has real, encodes from that.
+    struct fixed16 {
+        using scalar = int32_t;
+        using real = float;
+        static constexpr char const* name = "fixed16";
+        static scalar encode(double v) noexcept {
+            return static_cast<scalar>(std::clamp(std::floor(v * 0x10000 + 0.5), -0x1p31, 0x1p31 - 1));
+        }
+        static scalar encode(real v) noexcept {
+            // 2^31 - 128 is the largest float below 2^31.
+            return static_cast<scalar>(std::clamp(std::floor(v * 0x10000 + 0.5f), -0x1p31f, 0x1p31f - 128));
+        }
+        static real decode(scalar v) noexcept { return v * (1.0f / 0x10000); }
+        static scalar to_screen(scalar v, scalar origin, scalar scale) noexcept {
+            auto d = std::clamp<int64_t>(int64_t(v) - origin, INT32_MIN, INT32_MAX);
+            return static_cast<scalar>(std::clamp<int64_t>((d * scale) >> 16, -(1 << 30), 1 << 30));
+        }
+        static splat_taps taps(scalar x, scalar y) noexcept {
+            uint64_t xr = x & 0xffff;
+            uint64_t yr = y & 0xffff;
+            uint64_t xi = 0x10000 - xr;
+            uint64_t yi = 0x10000 - yr;
+            return {
+                x >> 16,
+                y >> 16,
+                static_cast<unsigned>((255 * xi * yi) >> 32),
+                static_cast<unsigned>((255 * xi * yr) >> 32),
+                static_cast<unsigned>((255 * xr * yi) >> 32),
+                static_cast<unsigned>((255 * xr * yr) >> 32),
+            };
+        }
+    };
+    template <class F>
+    concept vertex_format_t = requires (typename F::scalar s, typename F::real v) {
+        { F::name } -> std::convertible_to<char const*>;
+        { F::encode(v) } -> std::same_as<typename F::scalar>;
+        { F::decode(s) } -> std::same_as<typename F::real>;
+        { F::to_screen(s, s, s) } -> std::same_as<typename F::scalar>;
+        { F::taps(s, s) } -> std::same_as<splat_taps>;
+    };
+} // ::vertex_formats
+
+// Compact description of a run of generated vertices; the device expands it
+// straight into the vertex store.
+template <class T>
+struct basic_primitive {
+    enum kind_t : uint32_t {
+        spiral, // a, then a + polar(sqrt(i), i*tau*phi) for i in [1, count)
+    };
+    kind_t kind;
+    uint32_t count;
+    T ax, ay;
+
+    template <class U>
+    [[nodiscard]] auto to() const noexcept -> basic_primitive<U> {
+        return { static_cast<typename basic_primitive<U>::kind_t>(this->kind), this->count,
+                 static_cast<U>(this->ax), static_cast<U>(this->ay) };
+    }
+    // The i-th generated vertex.
+    [[nodiscard]] std::complex<T> operator[](uint32_t i) const noexcept {
+        constexpr float tau = 2 * std::numbers::pi_v<double>;
+        constexpr float phi = std::numbers::phi_v<double>;
+        if (i == 0) return { this->ax, this->ay };
+        auto r = std::sqrt(static_cast<T>(i));
+        auto theta = static_cast<T>(i*tau*phi);
+        return { this->ax + r * std::cos(theta), this->ay + r * std::sin(theta) };
+    }
+};
+using primitive = basic_primitive<double>;
+
+// Pixels touched by the splats of the vertices p generates.
+[[nodiscard]] inline rect footprint(primitive const& p) noexcept {
+    if (p.count == 0) return {};
+    auto r = std::sqrt(p.count - 1.0);
+    return footprint(std::array{ std::complex{p.ax - r, p.ay - r}, std::complex{p.ax + r, p.ay + r} });
+}
+
+// Line segment from a to b, drawn one pixel wide with a tent filter across it.
+template <class T>
+struct basic_segment {
+    T ax, ay;
+    T bx, by;
+
+    template <class U>
+    [[nodiscard]] auto to() const noexcept -> basic_segment<U> {
+        return { static_cast<U>(this->ax), static_cast<U>(this->ay),
+                 static_cast<U>(this->bx), static_cast<U>(this->by) };
+    }
+    // Squared distance from (px, py) to the segment.
+    [[nodiscard]] T distance2(T px, T py) const noexcept {
+        auto dx = this->bx - this->ax;
+        auto dy = this->by - this->ay;
+        auto ex = px - this->ax;
+        auto ey = py - this->ay;
+        auto len2 = dx * dx + dy * dy;
+        auto h = len2 > 0 ? std::clamp((ex * dx + ey * dy) / len2, T(0), T(1)) : T(0);
+        ex -= h * dx;
+        ey -= h * dy;
+        return ex * ex + ey * ey;
+    }
+    // Weight of the pixel at (px, py); like a row of point splats one pixel
+    // apart, a pixel on the line gets 255 and it falls off to 0 a pixel away.
+    [[nodiscard]] unsigned coverage(T px, T py) const noexcept {
+        auto d2 = this->distance2(px, py);
+        if (d2 >= 1) return 0;
+        return static_cast<unsigned>(255 * (1 - std::sqrt(d2)));
+    }
+};
+using segment = basic_segment<double>;
+
+// Pixels with a non-zero coverage of s.
+[[nodiscard]] inline rect footprint(segment const& s) noexcept {
+    auto x0 = static_cast<int32_t>(std::floor(std::min(s.ax, s.bx)));
+    auto y0 = static_cast<int32_t>(std::floor(std::min(s.ay, s.by)));
+    auto x1 = static_cast<int32_t>(std::floor(std::max(s.ax, s.bx)));
+    auto y1 = static_cast<int32_t>(std::floor(std::max(s.ay, s.by)));
+    return { x0 - 1, y0 - 1, x1 - x0 + 3, y1 - y0 + 3 };
+}
+
+// A run of count vertices a frame walks, the start-th to the
+// (start + count - 1)-th of the frame. Indirect runs are positions in the
+// store's grid order; direct ones are vertex indices.
+struct vertex_run {
+    uint32_t first;
+    uint32_t count;
+    uint32_t start;
+    uint32_t indirect;
+};
+
+// Cells per side of the grid a vertex store indexes its vertices with.
+constexpr uint32_t grid_size = 256;
+
+// Cells [x0, x1] x [y0, y1] of a grid_size x grid_size grid over bounds (min
+// x, min y, max x, max y in world coordinates) that may hold vertices whose
+// splats land in the screen pixels of region under view; empty if x1 < x0.
+struct grid_cells {
+    int32_t x0, y0, x1, y1;
+};
+template <class T>
+[[nodiscard]] inline grid_cells visible_cells(std::array<T, 4> const& bounds, viewport const& view, rect region) noexcept {
+    constexpr uint32_t g = grid_size;
+    // Splats reach a pixel past the surface; one more cell on either side
+    // makes up for the device rounding in its own arithmetic.
+    auto lo = view.to_world({ region.x - 2.0, region.y - 2.0 });
+    auto hi = view.to_world({ region.x + region.cx + 2.0, region.y + region.cy + 2.0 });
+    auto [x0, y0, x1, y1] = bounds;
+    auto sx = g / std::max<double>(x1 - x0, 1);
+    auto sy = g / std::max<double>(y1 - y0, 1);
+    auto cell = [](double v) noexcept {
+        return static_cast<int32_t>(std::clamp(std::floor(v), -1.0 - g, 1.0 + g));
+    };
+    return {
+        std::max(cell((lo.real() - x0) * sx) - 1, 0),
+        std::max(cell((lo.imag() - y0) * sy) - 1, 0),
+        std::min(cell((hi.real() - x0) * sx) + 1, int32_t(g - 1)),
+        std::min(cell((hi.imag() - y0) * sy) + 1, int32_t(g - 1)),
+    };
+}
+
+// Device-resident vertices in format F, as separate x and y arrays. Index 0
+// is the cursor; everything after it is append-only, either uploaded from the
+// host or generated on the device from primitives. Line segments are kept
+// alongside, as endpoints in F::real.
+//
+// Vertices are indexed by a grid_size x grid_size uniform grid over their
+// world bounding box, so that a frame only walks the cells in view; those
+// appended since the last reindex() form an unindexed tail that every frame
+// walks in full.
+//
+// Nothing here waits for the device. Buffers outgrown by a transfer, and
+// host copies a transfer reads from, are kept until settle(), which the
+// caller makes once everything submitted so far has completed; that is also
+// when a rebuilt grid takes effect.
+//
+// What the frame's kernels read, the vertices, the segments and the grid
+// order, is allocated as kind, which has to be shared when other queues than
+// que render from the store.
+template <vertex_format_t F>
+struct vertex_store {
+    using format = F;
+    using scalar = typename F::scalar;
+    using real = typename F::real;
+    usm_unique_ptr<scalar> xs;
+    usm_unique_ptr<scalar> ys;
+    size_t size = 0;     // vertices stored so far
+    size_t capacity = 0;
+    // Host-side sources of transfers in flight; they stay untouched until the
+    // caller has waited on the queue.
+    std::array<scalar, 2> cursor;
+    std::vector<std::vector<scalar>> staging;
+    std::vector<basic_primitive<real>> primitives;
+    std::vector<uint32_t> offsets;
+    usm_unique_ptr<basic_primitive<real>> primitives_dev;
+    usm_unique_ptr<uint32_t> offsets_dev;
+    size_t primitives_capacity = 0;
+    usm_unique_ptr<basic_segment<real>> segments;
+    std::vector<basic_segment<real>> segments_staging;
+    size_t segment_count = 0;
+    size_t segment_capacity = 0;
+    usm_unique_ptr<uint32_t> cells;     // cell -> first position in order, one extra for the total
+    usm_unique_ptr<uint32_t> cell_counts;
+    usm_unique_ptr<uint32_t> order;     // indexed vertices grouped by cell
+    usm_unique_ptr<real> extent;        // min x, min y, max x, max y
+    size_t order_capacity = 0;
+    std::vector<uint32_t> cells_host;   // cells as of the last settled reindex()
+    std::array<real, 4> bounds{};       // extent as of the last settled reindex()
+    size_t indexed = 1;                 // vertices [1, indexed) are in the grid
+    std::vector<uint32_t> cells_read;   // cells and extent of a reindex() in flight
+    std::array<real, 4> bounds_read{};
+    size_t reindexed = 0;               // its indexed, or 0 if none is in flight
+    std::vector<usm_unique_ptr<std::byte>> retired;
+    sycl::usm::alloc kind;
+
+    explicit vertex_store(sycl::queue& que, sycl::usm::alloc kind = sycl::usm::alloc::device) noexcept
+        : xs{nullptr, usm_deleter{&que}}, ys{nullptr, usm_deleter{&que}},
+          primitives_dev{nullptr, usm_deleter{&que}}, offsets_dev{nullptr, usm_deleter{&que}},
+          segments{nullptr, usm_deleter{&que}},
+          cells{nullptr, usm_deleter{&que}}, cell_counts{nullptr, usm_deleter{&que}},
+          order{nullptr, usm_deleter{&que}}, extent{nullptr, usm_deleter{&que}},
+          kind{kind}
+    {
+    }
+    // Call once the queue has drained.
+    void settle() noexcept {
+        this->retired.clear();
+        this->staging.clear();
+        if (this->reindexed) {
+            std::swap(this->cells_host, this->cells_read);
+            this->bounds = this->bounds_read;
+            this->indexed = std::exchange(this->reindexed, 0);
+        }
+    }
+    // Keeps a buffer transfers may still read from until settle().
+    template <class T>
+    void retire(usm_unique_ptr<T>& ptr) noexcept {
+        auto deleter = ptr.get_deleter();
+        this->retired.emplace_back(reinterpret_cast<std::byte*>(ptr.release()), deleter);
+    }
+    [[nodiscard]] bool reserve(sycl::queue& que, size_t count) noexcept {
+        if (count <= this->capacity) return true;
+        auto capacity = std::max(count, 2 * this->capacity);
+        auto xs = malloc_unique<scalar>(capacity, que, this->kind);
+        auto ys = malloc_unique<scalar>(capacity, que, this->kind);
+        if (!xs || !ys) {
+            std::cerr << "sycl::malloc failed..." << std::endl;
+            return false;
+        }
+        if (this->size) {
+            que.memcpy(xs.get(), this->xs.get(), this->size * sizeof (scalar));
+            que.memcpy(ys.get(), this->ys.get(), this->size * sizeof (scalar));
+        }
+        this->retire(this->xs);
+        this->retire(this->ys);
+        this->xs = std::move(xs);
+        this->ys = std::move(ys);
+        this->capacity = capacity;
+        return true;
+    }
+    [[nodiscard]] bool set_cursor(sycl::queue& que, std::complex<double> pt) noexcept {
+        if (!this->reserve(que, 1)) return false;
+        this->size = std::max<size_t>(this->size, 1);
+        this->cursor = { F::encode(pt.real()), F::encode(pt.imag()) };
+        que.memcpy(this->xs.get(), &this->cursor[0], sizeof (scalar));
+        que.memcpy(this->ys.get(), &this->cursor[1], sizeof (scalar));
+        return true;
+    }
+    // Uploads ready-made vertices, through a staging copy of their own.
+    [[nodiscard]] bool append(sycl::queue& que, std::span<std::complex<double> const> points) noexcept {
+        auto first = std::max<size_t>(this->size, 1);
+        if (points.empty()) return true;
+        if (!this->reserve(que, first + points.size())) return false;
+        auto count = points.size();
+        auto& staging = this->staging.emplace_back(2 * count);
+        for (size_t i = 0; i < count; ++i) {
+            staging[i] = F::encode(points[i].real());
+            staging[count + i] = F::encode(points[i].imag());
+        }
+        que.memcpy(this->xs.get() + first, staging.data(), count * sizeof (scalar));
+        que.memcpy(this->ys.get() + first, staging.data() + count, count * sizeof (scalar));
+        this->size = first + count;
+        return true;
+    }
+    // Generates the vertices of prims on the device, one work-item per vertex.
+    [[nodiscard]] bool append(sycl::queue& que, std::span<primitive const> prims) noexcept {
+        auto first = std::max<size_t>(this->size, 1);
+        this->primitives.clear();
+        this->offsets.clear();
+        uint32_t total = 0;
+        for (auto const& p : prims) {
+            if (p.count == 0) continue;
+            this->primitives.push_back(p.template to<real>());
+            this->offsets.push_back(total);
+            total += p.count;
+        }
+        if (total == 0) return true;
+        if (!this->reserve(que, first + total)) return false;
+        auto n = this->primitives.size();
+        if (n > this->primitives_capacity) {
+            auto capacity = std::max(n, 2 * this->primitives_capacity);
+            this->primitives_dev = malloc_device_unique<basic_primitive<real>>(capacity, que);
+            this->offsets_dev = malloc_device_unique<uint32_t>(capacity, que);
+            if (!this->primitives_dev || !this->offsets_dev) {
+                std::cerr << "sycl::malloc_device failed..." << std::endl;
+                this->primitives_capacity = 0;
+                return false;
+            }
+            this->primitives_capacity = capacity;
+        }
+        auto pd = this->primitives_dev.get();
+        auto od = this->offsets_dev.get();
+        que.memcpy(pd, this->primitives.data(), n * sizeof (basic_primitive<real>));
+        que.memcpy(od, this->offsets.data(), n * sizeof (uint32_t));
+        auto xs = this->xs.get() + first;
+        auto ys = this->ys.get() + first;
+        que.parallel_for(total, [=](sycl::item<1> it) noexcept {
+            auto k = static_cast<uint32_t>(it.get_linear_id());
+            // The last primitive whose first vertex is at or before k.
+            size_t lo = 0, hi = n;
+            while (hi - lo > 1) {
+                auto mid = (lo + hi) / 2;
+                if (od[mid] <= k) lo = mid;
+                else hi = mid;
+            }
+            auto pt = pd[lo][k - od[lo]];
+            xs[k] = F::encode(pt.real());
+            ys[k] = F::encode(pt.imag());
+        });
+        this->size = first + total;
+        return true;
+    }
+    [[nodiscard]] bool append(sycl::queue& que, std::span<segment const> segs) noexcept {
+        if (segs.empty()) return true;
+        auto count = this->segment_count + segs.size();
+        if (count > this->segment_capacity) {
+            auto capacity = std::max(count, 2 * this->segment_capacity);
+            auto segments = malloc_unique<basic_segment<real>>(capacity, que, this->kind);
+            if (!segments) {
+                std::cerr << "sycl::malloc failed..." << std::endl;
+                return false;
+            }
+            if (this->segment_count) {
+                que.memcpy(segments.get(), this->segments.get(),
+                           this->segment_count * sizeof (basic_segment<real>));
+            }
+            this->retire(this->segments);
+            this->segments = std::move(segments);
+            this->segment_capacity = capacity;
+        }
+        this->segments_staging.clear();
+        for (auto const& s : segs) this->segments_staging.push_back(s.template to<real>());
+        que.memcpy(this->segments.get() + this->segment_count, this->segments_staging.data(),
+                   segs.size() * sizeof (basic_segment<real>));
+        this->segment_count = count;
+        return true;
+    }
+    // Rebuilds the grid over every vertex but the cursor once the unindexed
+    // tail outgrows an eighth of the indexed ones, so that appending stays
+    // amortised linear. The grid is built on the device and read back for
+    // visible() as of settle(); until then frames walk every vertex directly.
+    [[nodiscard]] bool reindex(sycl::queue& que) noexcept {
+        if (this->reindexed) return true;
+        auto tail = this->size - std::min(this->size, this->indexed);
+        if (tail <= std::max<size_t>(1 << 16, this->indexed / 8)) return true;
+        constexpr uint32_t g = grid_size;
+        if (!this->cells) {
+            this->cells = malloc_device_unique<uint32_t>(g * g + 1, que);
+            this->cell_counts = malloc_device_unique<uint32_t>(g * g + 1, que);
+            this->extent = malloc_device_unique<real>(4, que);
+            if (!this->cells || !this->cell_counts || !this->extent) {
+                std::cerr << "sycl::malloc_device failed..." << std::endl;
+                this->cells.reset();
+                return false;
+            }
+        }
+        if (this->size > this->order_capacity) {
+            auto capacity = std::max(this->size, 2 * this->order_capacity);
+            this->order = malloc_unique<uint32_t>(capacity, que, this->kind);
+            if (!this->order) {
+                std::cerr << "sycl::malloc failed..." << std::endl;
+                this->order_capacity = 0;
+                return false;
+            }
+            this->order_capacity = capacity;
+        }
+        auto xs = this->xs.get();
+        auto ys = this->ys.get();
+        auto cells = this->cells.get();
+        auto counts = this->cell_counts.get();
+        auto order = this->order.get();
+        auto extent = this->extent.get();
+        auto count = this->size - 1;
+        using bound = sycl::atomic_ref<real, sycl::memory_order::relaxed, sycl::memory_scope::device>;
+        que.single_task([=]() noexcept {
+            extent[0] = extent[1] = std::numeric_limits<real>::max();
+            extent[2] = extent[3] = std::numeric_limits<real>::lowest();
+        });
+        que.parallel_for(count, [=](sycl::item<1> idx) noexcept {
+            auto x = F::decode(xs[idx + 1]);
+            auto y = F::decode(ys[idx + 1]);
+            bound(extent[0]).fetch_min(x);
+            bound(extent[1]).fetch_min(y);
+            bound(extent[2]).fetch_max(x);
+            bound(extent[3]).fetch_max(y);
+        });
+        auto cell_of = [=](uint32_t i) noexcept {
+            auto x0 = extent[0];
+            auto y0 = extent[1];
+            auto sx = g / std::max(extent[2] - x0, real(1));
+            auto sy = g / std::max(extent[3] - y0, real(1));
+            auto cx = std::clamp(static_cast<int32_t>((F::decode(xs[i]) - x0) * sx), 0, int32_t(g - 1));
+            auto cy = std::clamp(static_cast<int32_t>((F::decode(ys[i]) - y0) * sy), 0, int32_t(g - 1));
+            return static_cast<uint32_t>(cy * g + cx);
+        };
+        using counter = sycl::atomic_ref<uint32_t, sycl::memory_order::relaxed, sycl::memory_scope::device>;
+        que.memset(counts, 0, (g * g + 1) * sizeof (uint32_t));
+        que.parallel_for(count, [=](sycl::item<1> idx) noexcept {
+            counter(counts[cell_of(idx + 1)]).fetch_add(1u);
+        });
+        que.parallel_for(sycl::nd_range<1>(256, 256), [=](sycl::nd_item<1> it) noexcept {
+            sycl::joint_exclusive_scan(it.get_group(), counts, counts + g * g + 1, cells, sycl::plus<uint32_t>{});
+        });
+        que.memcpy(counts, cells, g * g * sizeof (uint32_t));
+        que.parallel_for(count, [=](sycl::item<1> idx) noexcept {
+            auto i = static_cast<uint32_t>(idx + 1);
+            order[counter(counts[cell_of(i)]).fetch_add(1u)] = i;
+        });
+        this->cells_read.resize(g * g + 1);
+        que.memcpy(this->cells_read.data(), cells, (g * g + 1) * sizeof (uint32_t));
+        que.memcpy(this->bounds_read.data(), extent, sizeof this->bounds_read);
+        this->reindexed = this->size;
+        return true;
+    }
+    // The runs of vertices to walk for the screen pixels of regions within
+    // bounds under view: the cursor, the indexed vertices of the grid cells
+    // that may show in any region, each cell once, and the unindexed tail;
+    // just every vertex while a reindex() is in flight, since it reorders the
+    // grid. Returns the number of vertices the runs cover.
+    uint32_t visible(viewport const& view, std::vector<rect> const& regions, rect bounds,
+                     std::vector<vertex_run>& runs) const noexcept
+    {
+        constexpr uint32_t g = grid_size;
+        runs.clear();
+        uint32_t start = 0;
+        auto push = [&](uint32_t first, uint32_t count, bool indirect) noexcept {
+            if (count == 0) return ;
+            if (!runs.empty() && runs.back().indirect == indirect && runs.back().first + runs.back().count == first) {
+                runs.back().count += count;
+            }
+            else {
+                runs.push_back({ first, count, start, indirect });
+            }
+            start += count;
+        };
+        push(0, std::min<uint32_t>(this->size, 1), false);
+        auto indexed = this->reindexed ? 1 : std::min(this->indexed, this->size);
+        if (indexed > 1 && !this->cells_host.empty()) {
+            std::vector<grid_cells> cells;
+            for (auto r : regions) {
+                r = intersected(r, bounds);
+                if (r.empty()) continue;
+                auto c = visible_cells(this->bounds, view, r);
+                if (c.x0 <= c.x1 && c.y0 <= c.y1) cells.push_back(c);
+            }
+            // The spans of cells of a row, merged where regions overlap.
+            std::vector<std::pair<int32_t, int32_t>> spans;
+            for (int32_t cy = 0; cy < int32_t(g); ++cy) {
+                spans.clear();
+                for (auto const& c : cells) {
+                    if (c.y0 <= cy && cy <= c.y1) spans.emplace_back(c.x0, c.x1);
+                }
+                std::sort(spans.begin(), spans.end());
+                for (size_t i = 0; i < spans.size(); ) {
+                    auto [cx0, cx1] = spans[i];
+                    for (++i; i < spans.size() && spans[i].first <= cx1 + 1; ++i) cx1 = std::max(cx1, spans[i].second);
+                    auto first = this->cells_host[cy * g + cx0];
+                    push(first, this->cells_host[cy * g + cx1 + 1] - first, true);
+                }
+            }
+        }
+        if (indexed < this->size) push(std::max<size_t>(indexed, 1), this->size - std::max<size_t>(indexed, 1), false);
+        return start;
+    }
+};
+
+using any_vertex_store = std::variant<vertex_store<fp64>, vertex_store<fp32>, vertex_store<fixed16>>;
+
+// Store for the format named format; anything unrecognised falls back to fp32.
+inline auto make_vertex_store(std::string_view format, sycl::queue& que, sycl::usm::alloc kind = sycl::usm::alloc::device) noexcept
+-> any_vertex_store
+{
+    if (format == fp64::name) return any_vertex_store{std::in_place_type<vertex_store<fp64>>, que, kind};
+    if (format == fixed16::name) return any_vertex_store{std::in_place_type<vertex_store<fixed16>>, que, kind};
+    return any_vertex_store{std::in_place_type<vertex_store<fp32>>, que, kind};
+}
+
+// Vertex and segment indices binned by screen tile, for the damaged tiles
+// only; the splat runs a work-group per bin and writes each pixel once.
+struct tile_bins {
+    static constexpr uint32_t tile_size = 16;
+    static constexpr uint32_t none = ~0u;
+    static constexpr uint32_t segment_bit = 1u << 31; // tags segment entries
+    // Items walked per binning work-group.
+    static constexpr uint32_t group_items = 16 * tile_size * tile_size;
+    sycl::range<2> tiles{0, 0};
+    std::vector<uint32_t> slots;            // tile -> bin, or none
+    std::vector<uint32_t> dirty;            // bin -> tile
+    usm_unique_ptr<uint32_t> slots_dev;
+    usm_unique_ptr<uint32_t> dirty_dev;
+    usm_unique_ptr<uint32_t> counts;        // entries per bin
+    usm_unique_ptr<uint32_t> offsets;       // exclusive scan of counts, one extra for the total
+    usm_unique_ptr<uint32_t> cursors;       // scatter positions
+    usm_unique_ptr<uint32_t> entries;       // vertex and segment indices grouped by bin
+    size_t capacity = 0;                    // of entries
+    size_t tile_capacity = 0;               // of the per-tile arrays
+    std::vector<vertex_run> runs;           // vertices the current frame walks
+    usm_unique_ptr<vertex_run> runs_dev;    // room for runs_capacity of them
+    size_t runs_capacity = grid_size + 2;   // a run per grid row, the cursor and the tail
+    uint32_t local_bins;                    // bins counted in local memory at a time, as many as it holds
+    // What binning() leaves splatting(): the bins in use, the vertices walked
+    // ahead of the segments, vertices and segments together, the whole tiles
+    // segments are clipped to, and the entry count, once read back.
+    size_t used = 0;
+    uint32_t walked = 0;
+    uint32_t items = 0;
+    rect binned{};
+    uint32_t total = 0;
+
+    tile_bins(sycl::queue& que, sycl::range<2> dim) noexcept
+        : slots_dev{nullptr, usm_deleter{&que}},
+          dirty_dev{nullptr, usm_deleter{&que}},
+          counts{nullptr, usm_deleter{&que}},
+          offsets{nullptr, usm_deleter{&que}},
+          cursors{nullptr, usm_deleter{&que}},
+          entries{nullptr, usm_deleter{&que}},
+          runs_dev{malloc_device_unique<vertex_run>(grid_size + 2, que)},
+          // Less a kilobyte the implementation may keep for itself.
+          local_bins{static_cast<uint32_t>(
+              std::max<size_t>(que.get_device().get_info<sycl::info::device::local_mem_size>(), 16384) / sizeof (uint32_t) - 256)}
+    {
+        this->runs.reserve(grid_size + 2);
+        [[maybe_unused]] auto ok = this->resize(que, dim);
+    }
+    explicit operator bool() const noexcept {
+        return this->slots_dev && this->dirty_dev && this->counts && this->offsets && this->cursors && this->runs_dev;
+    }
+    // Covers a frame of dim. The per-tile arrays only grow, so shrinking and
+    // growing back, as an interactive resize does, does not reallocate.
+    [[nodiscard]] bool resize(sycl::queue& que, sycl::range<2> dim) noexcept {
+        auto tiles = sycl::range<2>{(dim[0] + tile_size - 1) / tile_size, (dim[1] + tile_size - 1) / tile_size};
+        if (tiles[0] == this->tiles[0] && tiles[1] == this->tiles[1] && *this) return true;
+        this->tiles = tiles;
+        this->slots.assign(tiles.size(), none);
+        this->dirty.clear();
+        this->dirty.reserve(tiles.size());
+        if (tiles.size() <= this->tile_capacity) return true;
+        auto capacity = std::max(tiles.size(), 2 * this->tile_capacity);
+        this->slots_dev = malloc_device_unique<uint32_t>(capacity, que);
+        this->dirty_dev = malloc_device_unique<uint32_t>(capacity, que);
+        this->counts = malloc_device_unique<uint32_t>(capacity + 1, que);
+        this->offsets = malloc_device_unique<uint32_t>(capacity + 1, que);
+        this->cursors = malloc_device_unique<uint32_t>(capacity, que);
+        if (!*this) {
+            std::cerr << "sycl::malloc_device failed..." << std::endl;
+            this->tile_capacity = 0;
+            return false;
+        }
+        this->tile_capacity = capacity;
+        return true;
+    }
+    // Assigns a bin to every tile intersecting damage and returns the number of bins.
+    size_t mark(std::vector<rect> const& damage, rect bounds) noexcept {
+        for (auto tile : this->dirty) this->slots[tile] = none;
+        this->dirty.clear();
+        for (auto r : damage) {
+            r = intersected(r, bounds);
+            if (r.empty()) continue;
+            for (uint32_t ty = r.y / tile_size; ty <= (r.y + r.cy - 1) / tile_size; ++ty) {
+                for (uint32_t tx = r.x / tile_size; tx <= (r.x + r.cx - 1) / tile_size; ++tx) {
+                    auto tile = ty * this->tiles[1] + tx;
+                    if (this->slots[tile] == none) {
+                        this->slots[tile] = this->dirty.size();
+                        this->dirty.push_back(tile);
+                    }
+                }
+            }
+        }
+        return this->dirty.size();
+    }
+};
+
+// Layouts of a pixel in the shm buffers, one per wl_shm format drawn into.
+// channels gives the width and shift of alpha, red, green and blue in turn; a
+// format without alpha has a zero width there.
+inline namespace pixel_formats {
+    struct channel {
+        uint32_t bits;
+        uint32_t shift;
+    };
+    struct argb8888 {
+        using pixel = uint32_t;
+        static constexpr char const* name = "argb8888";
+        static constexpr uint32_t shm_format = 0; // WL_SHM_FORMAT_ARGB8888
+        static constexpr std::array<channel, 4> channels{{ {8, 24}, {8, 16}, {8, 8}, {8, 0} }};
+    };
+    struct xrgb8888 {
+        using pixel = uint32_t;
+        static constexpr char const* name = "xrgb8888";
+        static constexpr uint32_t shm_format = 1; // WL_SHM_FORMAT_XRGB8888
+        static constexpr std::array<channel, 4> channels{{ {0, 24}, {8, 16}, {8, 8}, {8, 0} }};
+    };
+    struct abgr2101010 {
+        using pixel = uint32_t;
+        static constexpr char const* name = "abgr2101010";
+        static constexpr uint32_t shm_format = 0x30334241; // WL_SHM_FORMAT_ABGR2101010
+        static constexpr std::array<channel, 4> channels{{ {2, 30}, {10, 0}, {10, 10}, {10, 20} }};
+    };
+    // Half the shm buffers and bandwidth to the compositor of the others.
+    struct rgb565 {
+        using pixel = uint16_t;
+        static constexpr char const* name = "rgb565";
+        static constexpr uint32_t shm_format = 0x36314752; // WL_SHM_FORMAT_RGB565
+        static constexpr std::array<channel, 4> channels{{ {0, 0}, {5, 11}, {6, 5}, {5, 0} }};
+    };
+    template <class P>
+    concept pixel_format_t = requires {
+        typename P::pixel;
+        { P::name } -> std::convertible_to<char const*>;
+        { P::shm_format } -> std::convertible_to<uint32_t>;
+        { P::channels[0] } -> std::convertible_to<channel>;
+    };
+} // ::pixel_formats
+
+// In order of preference. wl_shm requires every compositor to support the
+// first two, so the first is the one chosen unless another is named: the
+// surface is opaque, and without alpha the compositor need not blend it.
+// Whether the bandwidth rgb565 saves is worth its precision, or abgr2101010's
+// precision worth having, is up to the deployment, which names them.
+using any_pixel_format = std::variant<xrgb8888, argb8888, abgr2101010, rgb565>;
+
+// The first format of any_pixel_format among supported (wl_shm format codes),
+// or the one called preferred if it is among them.
+[[nodiscard]] inline auto make_pixel_format(std::string_view preferred, std::span<uint32_t const> supported) noexcept
+-> std::optional<any_pixel_format>
+{
+    std::optional<any_pixel_format> ret;
+    auto consider = [&](auto format) noexcept {
+        using P = decltype (format);
+        if (std::ranges::find(supported, P::shm_format) == supported.end()) return ;
+        if (!ret || P::name == preferred) ret = format;
+    };
+    [&]<size_t... I>(std::index_sequence<I...>) noexcept {
+        (consider(std::variant_alternative_t<I, any_pixel_format>{}), ...);
+    }(std::make_index_sequence<std::variant_size_v<any_pixel_format>>{});
+    return ret;
+}
+
+// Pixels per row of a frame cx pixels wide in format P; rows are padded to
+// whole 32-bit words, as compositors expect of shm buffers.
+template <pixel_format_t P>
+[[nodiscard]] constexpr size_t row_pitch(size_t cx) noexcept {
+    return (cx * sizeof (typename P::pixel) + 3) / 4 * 4 / sizeof (typename P::pixel);
+}
+
+// Adds the 8-bit values a, r, g and b to the channels of lhs, each scaled to
+// its channel's width and saturating there.
+template <pixel_format_t P>
+inline typename P::pixel& assign(typename P::pixel& lhs, auto a, auto r, auto g, auto b) noexcept {
+    int32_t rhs[] = {
+        static_cast<int32_t>(a),
+        static_cast<int32_t>(r),
+        static_cast<int32_t>(g),
+        static_cast<int32_t>(b),
+    };
+    auto channel = [&]<size_t I>(std::integral_constant<size_t, I>) noexcept -> uint32_t {
+        constexpr auto c = P::channels[I];
+        if constexpr (c.bits == 0) {
+            return 0;
+        }
+        else {
+            constexpr int32_t max = (1 << c.bits) - 1;
+            int32_t x = (lhs >> c.shift) & max;
+            auto v = max == 0xff ? rhs[I] : (rhs[I] * max + 127) / 255;
+            return static_cast<uint32_t>(std::min(max, x + v)) << c.shift;
+        }
+    };
+    return lhs = [&]<size_t... I>(std::index_sequence<I...>) noexcept {
+        return static_cast<typename P::pixel>((channel(std::integral_constant<size_t, I>{}) | ...));
+    }(std::make_index_sequence<4>{});
+}
+
+// Calls f with the index of every distinct tile that the 2x2 splat at (x, y) touches.
+inline void for_each_tile(int32_t x, int32_t y, sycl::range<2> dim, sycl::range<2> tiles, auto f) noexcept {
+    constexpr int32_t t = tile_bins::tile_size;
+    int32_t tx[2], ty[2];
+    int nx = 0, ny = 0;
+    for (auto px : { x, x + 1 }) {
+        if (0 <= px && px < (int32_t) dim[1] && (nx == 0 || tx[nx - 1] != px / t)) tx[nx++] = px / t;
+    }
+    for (auto py : { y, y + 1 }) {
+        if (0 <= py && py < (int32_t) dim[0] && (ny == 0 || ty[ny - 1] != py / t)) ty[ny++] = py / t;
+    }
+    for (int j = 0; j < ny; ++j) {
+        for (int i = 0; i < nx; ++i) {
+            f(static_cast<uint32_t>(ty[j] * tiles[1] + tx[i]));
+        }
+    }
+}
+
+// Calls f with the index of every binned tile that may hold a pixel covered
+// by s: those of its bounding box within clip (which lies inside the frame)
+// that have a bin and whose centre is close enough to the segment. A segment
+// away from the damage costs a bounding box test, whatever its length.
+template <class T>
+inline void for_each_tile(basic_segment<T> const& s, rect clip, uint32_t const* slots, sycl::range<2> tiles, auto f) noexcept {
+    constexpr int32_t t = tile_bins::tile_size;
+    constexpr T reach = (t - 1) * std::numbers::sqrt2_v<T> / 2 + 1;
+    auto x0 = std::max(T(clip.x), std::floor(std::min(s.ax, s.bx)) - 1);
+    auto y0 = std::max(T(clip.y), std::floor(std::min(s.ay, s.by)) - 1);
+    auto x1 = std::min(T(clip.x + clip.cx - 1), std::floor(std::max(s.ax, s.bx)) + 1);
+    auto y1 = std::min(T(clip.y + clip.cy - 1), std::floor(std::max(s.ay, s.by)) + 1);
+    if (x1 < x0 || y1 < y0) return;
+    for (auto ty = static_cast<int32_t>(y0) / t; ty <= static_cast<int32_t>(y1) / t; ++ty) {
+        for (auto tx = static_cast<int32_t>(x0) / t; tx <= static_cast<int32_t>(x1) / t; ++tx) {
+            auto tile = static_cast<uint32_t>(ty * tiles[1] + tx);
+            if (slots[tile] == tile_bins::none) continue;
+            if (s.distance2(tx * t + T(t - 1) / 2, ty * t + T(t - 1) / 2) < reach * reach) f(tile);
+        }
+    }
+}
+
+// Relaxed atomic access to a uint32_t in work-group local memory.
+using local_atomic = sycl::atomic_ref<uint32_t,
+                                      sycl::memory_order::relaxed,
+                                      sycl::memory_scope::work_group,
+                                      sycl::access::address_space::local_space>;
+
+// Per-pixel sums of splat weights from outside the vertex store, such as a
+// streamed point file, drawn underneath the vertices. dim and view are the
+// frame the sums were taken over, which need not be the current one. The
+// sums are allocated as kind, like the vertex store's buffers.
+struct splat_layer {
+    static constexpr uint32_t saturation = 1u << 24;
+    usm_unique_ptr<uint32_t> sums;
+    sycl::range<2> dim{0, 0};
+    viewport view;
+    size_t capacity = 0;
+    sycl::usm::alloc kind;
+
+    explicit splat_layer(sycl::queue& que, sycl::usm::alloc kind = sycl::usm::alloc::device) noexcept
+        : sums{nullptr, usm_deleter{&que}}, kind{kind}
+    {
+    }
+};
+
+// Kernels submitted for one frame by binning() and splatting();
+// default-constructed when skipped.
+struct render_events {
+    sycl::event count;
+    sycl::event scan;
+    sycl::event scatter;
+    sycl::event splat;
+};
+
+// How the kernels of a frame get at what they walk: the k-th vertex of the
+// runs in bins, and vertices and segments in screen coordinates under view.
+template <vertex_format_t F>
+struct vertex_walk {
+    using scalar = typename F::scalar;
+    using real = typename F::real;
+    scalar const* xs;
+    scalar const* ys;
+    basic_segment<real> const* segs;
+    uint32_t const* order;
+    vertex_run const* runs;
+    size_t nruns;
+    scalar ox, oy, scale;
+    real rox, roy, rscale;
+
+    vertex_walk(vertex_store<F> const& vertices, tile_bins const& bins, viewport const& view) noexcept
+        : vertex_walk{vertices.xs.get(), vertices.ys.get(), bins, view}
+    {
+        this->segs = vertices.segments.get();
+        this->order = vertices.order.get();
+    }
+    // Over bare arrays of vertices, which have no segments nor grid order.
+    vertex_walk(scalar const* xs, scalar const* ys, tile_bins const& bins, viewport const& view) noexcept
+        : xs{xs}, ys{ys}, segs{nullptr}, order{nullptr}, runs{bins.runs_dev.get()}, nruns{bins.runs.size()},
+          ox{F::encode(view.origin.real())}, oy{F::encode(view.origin.imag())}, scale{F::encode(view.scale)},
+          rox{static_cast<real>(view.origin.real())}, roy{static_cast<real>(view.origin.imag())},
+          rscale{static_cast<real>(view.scale)}
+    {
+    }
+    // The vertex walked k-th.
+    uint32_t vertex(uint32_t k) const noexcept {
+        size_t lo = 0, hi = this->nruns;
+        while (hi - lo > 1) {
+            auto mid = (lo + hi) / 2;
+            if (this->runs[mid].start <= k) lo = mid;
+            else hi = mid;
+        }
+        auto j = this->runs[lo].first + (k - this->runs[lo].start);
+        return this->runs[lo].indirect ? this->order[j] : j;
+    }
+    scalar screen_x(uint32_t i) const noexcept { return F::to_screen(this->xs[i], this->ox, this->scale); }
+    scalar screen_y(uint32_t i) const noexcept { return F::to_screen(this->ys[i], this->oy, this->scale); }
+    splat_taps screen_taps(uint32_t i) const noexcept {
+        return F::taps(this->screen_x(i), this->screen_y(i));
+    }
+    basic_segment<real> screen_segment(uint32_t i) const noexcept {
+        auto s = this->segs[i];
+        return basic_segment<real>{
+            (s.ax - this->rox) * this->rscale, (s.ay - this->roy) * this->rscale,
+            (s.bx - this->rox) * this->rscale, (s.by - this->roy) * this->rscale,
+        };
+    }
+    // Calls f with every tile that the k-th item of a frame, walked vertices
+    // first and segments after them, lands in; see binning().
+    void for_each_tile(uint32_t k, uint32_t walked, sycl::range<2> dim, rect binned,
+                       uint32_t const* slots, sycl::range<2> tiles, auto f) const noexcept {
+        if (k < walked) {
+            auto [x, y, a, b, c, d] = this->screen_taps(this->vertex(k));
+            ::for_each_tile(x, y, dim, tiles, f);
+        }
+        else {
+            ::for_each_tile(this->screen_segment(k - walked), binned, slots, tiles, f);
+        }
+    }
+};
+
+// First half of the re-accumulation of every tile touched by damage: assigns
+// the tiles bins, and counts and scans the vertices and segments that fall
+// into each. Vertices and segments are in world coordinates and drawn under
+// view; only the grid cells that may show in a damaged rect are walked. The
+// number of entries is read back into bins, so splatting() may only follow
+// once all of it has completed.
+template <vertex_format_t F>
+auto binning(sycl::queue& que,
+             sycl::range<2> dim,
+             vertex_store<F> const& vertices,
+             tile_bins& bins,
+             viewport const& view,
+             std::vector<rect> const& damage) noexcept
+-> render_events
+{
+    render_events events;
+    constexpr uint32_t t = tile_bins::tile_size;
+    auto bounds = rect{ 0, 0, static_cast<int32_t>(dim[1]), static_cast<int32_t>(dim[0]) };
+    bins.used = 0;
+    if (!bins.resize(que, dim)) return events;
+    auto n = bins.mark(damage, bounds);
+    if (n == 0) return events;
+    auto size = vertices.visible(view, damage, bounds, bins.runs);
+    if (bins.runs.size() > bins.runs_capacity) {
+        auto capacity = std::max(bins.runs.size(), 2 * bins.runs_capacity);
+        bins.runs_dev = malloc_device_unique<vertex_run>(capacity, que);
+        if (!bins.runs_dev) {
+            std::cerr << "sycl::malloc_device failed..." << std::endl;
+            bins.runs_capacity = 0;
+            return events;
+        }
+        bins.runs_capacity = capacity;
+    }
+    // Whole tiles of the damage, those a segment can land in.
+    auto region = intersected(std::accumulate(damage.begin(), damage.end(), rect{}, united), bounds);
+    auto x0 = region.x / int32_t(t) * int32_t(t);
+    auto y0 = region.y / int32_t(t) * int32_t(t);
+    auto binned = intersected({ x0, y0, region.x + region.cx - x0 + int32_t(t), region.y + region.cy - y0 + int32_t(t) }, bounds);
+    auto items = size + static_cast<uint32_t>(vertices.segment_count);
+    que.memcpy(bins.runs_dev.get(), bins.runs.data(), bins.runs.size() * sizeof (vertex_run));
+    return binning(que, dim, vertex_walk<F>{vertices, bins, view}, bins, n, size, items, binned);
+}
+
+// binning() of the items of walk, size vertices and then segments, into the n
+// bins marked, with the runs of walk already on the device.
+template <vertex_format_t F>
+auto binning(sycl::queue& que,
+             sycl::range<2> dim,
+             vertex_walk<F> const& walk,
+             tile_bins& bins,
+             size_t n,
+             uint32_t size,
+             uint32_t items,
+             rect binned) noexcept
+-> render_events
+{
+    render_events events;
+    constexpr uint32_t t = tile_bins::tile_size;
+    auto tiles = bins.tiles;
+    auto slots = bins.slots_dev.get();
+    auto counts = bins.counts.get();
+    auto offsets = bins.offsets.get();
+    que.memcpy(slots, bins.slots.data(), bins.slots.size() * sizeof (uint32_t));
+    que.memcpy(bins.dirty_dev.get(), bins.dirty.data(), n * sizeof (uint32_t));
+    que.memset(counts, 0, (n + 1) * sizeof (uint32_t));
+    // Count the vertices and segments falling into each bin, a work-group's
+    // share at a time in local memory...
+    constexpr uint32_t w = t * t;
+    auto groups = (items + tile_bins::group_items - 1) / tile_bins::group_items;
+    auto window = static_cast<uint32_t>(std::min<size_t>(n, bins.local_bins));
+    events.count = que.submit([&](sycl::handler& h) noexcept {
+        auto hist = sycl::local_accessor<uint32_t, 1>(sycl::range<1>(window), h);
+        h.parallel_for(sycl::nd_range<1>(std::max<size_t>(groups, 1) * w, w), [=](sycl::nd_item<1> it) noexcept {
+            auto lid = static_cast<uint32_t>(it.get_local_id(0));
+            auto first = static_cast<uint32_t>(it.get_group(0)) * tile_bins::group_items;
+            auto last = std::min(first + tile_bins::group_items, items);
+            for (uint32_t lo = 0; lo < n; lo += window) {
+                for (auto b = lid; b < window; b += w) hist[b] = 0;
+                sycl::group_barrier(it.get_group());
+                for (auto k = first + lid; k < last; k += w) {
+                    walk.for_each_tile(k, size, dim, binned, slots, tiles, [&](uint32_t tile) noexcept {
+                        if (auto bin = slots[tile]; bin != tile_bins::none && bin - lo < window) {
+                            local_atomic(hist[bin - lo]).fetch_add(1u);
+                        }
+                    });
+                }
+                sycl::group_barrier(it.get_group());
+                for (auto b = lid; b < window && lo + b < n; b += w) {
+                    if (hist[b] == 0) continue;
+                    sycl::atomic_ref<uint32_t,
+                                     sycl::memory_order::relaxed,
+                                     sycl::memory_scope::device>(counts[lo + b]).fetch_add(hist[b]);
+                }
+                sycl::group_barrier(it.get_group());
+            }
+        });
+    });
+    // ...and turn the counts into bin offsets.
+    events.scan = que.parallel_for(sycl::nd_range<1>(256, 256), [=](sycl::nd_item<1> it) noexcept {
+        sycl::joint_exclusive_scan(it.get_group(), counts, counts + n + 1, offsets, sycl::plus<uint32_t>{});
+    });
+    que.memcpy(&bins.total, offsets + n, sizeof (uint32_t));
+    bins.used = n;
+    bins.walked = size;
+    bins.items = items;
+    bins.binned = binned;
+    return events;
+}
+
+// Second half: scatters the vertices and segments binned by binning() with
+// the same vertices, bins and view into their bins, and sums them into
+// density, the unclamped per-pixel sum of splat weights, a bin at a time.
+// Tiles without a bin are left untouched. The sums of layer, if any, are
+// added under them as they are. tone_mapping() turns density into pixels.
+template <vertex_format_t F>
+auto splatting(sycl::queue& que,
+               uint32_t* density,
+               sycl::range<2> dim,
+               vertex_store<F> const& vertices,
+               tile_bins& bins,
+               viewport const& view,
+               render_events events,
+               splat_layer const* layer = nullptr) noexcept
+-> render_events
+{
+    return splatting(que, density, dim, vertex_walk<F>{vertices, bins, view}, bins, events, layer);
+}
+
+// splatting() of the items of walk binned by binning(); the sums written are
+// clamped to ceiling. layer may hold density itself, to add to it.
+template <vertex_format_t F>
+auto splatting(sycl::queue& que,
+               uint32_t* density,
+               sycl::range<2> dim,
+               vertex_walk<F> const& walk,
+               tile_bins& bins,
+               render_events events,
+               splat_layer const* layer,
+               uint32_t ceiling = std::numeric_limits<uint32_t>::max()) noexcept
+-> render_events
+{
+    constexpr uint32_t t = tile_bins::tile_size;
+    auto n = bins.used;
+    if (n == 0) return events;
+    if (bins.total > bins.capacity) {
+        auto capacity = std::max<size_t>(bins.total, 2 * bins.capacity);
+        bins.entries = malloc_device_unique<uint32_t>(capacity, que);
+        if (!bins.entries) {
+            std::cerr << "sycl::malloc_device failed..." << std::endl;
+            bins.capacity = 0;
+            return events;
+        }
+        bins.capacity = capacity;
+    }
+    auto tiles = bins.tiles;
+    auto size = bins.walked;
+    auto binned = bins.binned;
+    auto slots = bins.slots_dev.get();
+    auto dirty = bins.dirty_dev.get();
+    auto offsets = bins.offsets.get();
+    auto cursors = bins.cursors.get();
+    auto entries = bins.entries.get();
+    // Each work-group counts its share of every bin again, reserves room for
+    // it with one global atomic, and hands out positions within that room in
+    // local memory. The order within a bin is arbitrary, which is fine since
+    // the sums below commute.
+    constexpr uint32_t w = t * t;
+    auto items = bins.items;
+    auto groups = (items + tile_bins::group_items - 1) / tile_bins::group_items;
+    auto window = static_cast<uint32_t>(std::min<size_t>(n, bins.local_bins));
+    que.memcpy(cursors, offsets, n * sizeof (uint32_t));
+    events.scatter = que.submit([&](sycl::handler& h) noexcept {
+        auto hist = sycl::local_accessor<uint32_t, 1>(sycl::range<1>(window), h);
+        h.parallel_for(sycl::nd_range<1>(std::max<size_t>(groups, 1) * w, w), [=](sycl::nd_item<1> it) noexcept {
+            auto lid = static_cast<uint32_t>(it.get_local_id(0));
+            auto first = static_cast<uint32_t>(it.get_group(0)) * tile_bins::group_items;
+            auto last = std::min(first + tile_bins::group_items, items);
+            for (uint32_t lo = 0; lo < n; lo += window) {
+                auto in_window = [&](uint32_t tile, auto f) noexcept {
+                    if (auto bin = slots[tile]; bin != tile_bins::none && bin - lo < window) f(bin - lo);
+                };
+                for (auto b = lid; b < window; b += w) hist[b] = 0;
+                sycl::group_barrier(it.get_group());
+                for (auto k = first + lid; k < last; k += w) {
+                    walk.for_each_tile(k, size, dim, binned, slots, tiles, [&](uint32_t tile) noexcept {
+                        in_window(tile, [&](uint32_t b) noexcept { local_atomic(hist[b]).fetch_add(1u); });
+                    });
+                }
+                sycl::group_barrier(it.get_group());
+                for (auto b = lid; b < window && lo + b < n; b += w) {
+                    if (hist[b] == 0) continue;
+                    hist[b] = sycl::atomic_ref<uint32_t,
+                                               sycl::memory_order::relaxed,
+                                               sycl::memory_scope::device>(cursors[lo + b]).fetch_add(hist[b]);
+                }
+                sycl::group_barrier(it.get_group());
+                for (auto k = first + lid; k < last; k += w) {
+                    auto entry = k < size ? walk.vertex(k) : (k - size) | tile_bins::segment_bit;
+                    walk.for_each_tile(k, size, dim, binned, slots, tiles, [&](uint32_t tile) noexcept {
+                        in_window(tile, [&](uint32_t b) noexcept { entries[local_atomic(hist[b]).fetch_add(1u)] = entry; });
+                    });
+                }
+                sycl::group_barrier(it.get_group());
+            }
+        });
+    });
+    // One work-group per bin, one work-item per pixel of its tile. The tile's
+    // sums are kept in local memory; every work-item takes a stride of the
+    // bin's entries and adds their taps, and the coverage of their segments
+    // within the tile, with local atomics. Integer adds commute, so the sums
+    // do not depend on the order, and the tile is written exactly once.
+    auto stride = dim[1];
+    auto base = layer && layer->sums ? layer->sums.get() : nullptr;
+    auto base_dim = layer ? layer->dim : sycl::range<2>{0, 0};
+    events.splat = que.submit([&](sycl::handler& h) noexcept {
+        auto sums = sycl::local_accessor<uint32_t, 1>(sycl::range<1>(w), h);
+        h.parallel_for(sycl::nd_range<1>(n * w, w), [=](sycl::nd_item<1> it) noexcept {
+            using real = typename F::real;
+            auto bin = it.get_group(0);
+            auto lid = static_cast<uint32_t>(it.get_local_id(0));
+            auto tile = dirty[bin];
+            auto tx = static_cast<int32_t>(tile % tiles[1] * t);
+            auto ty = static_cast<int32_t>(tile / tiles[1] * t);
+            auto px = tx + static_cast<int32_t>(lid % t);
+            auto py = ty + static_cast<int32_t>(lid / t);
+            uint32_t sum = 0;
+            if (base && px < (int32_t) base_dim[1] && py < (int32_t) base_dim[0]) {
+                sum = base[py * base_dim[1] + px];
+            }
+            sums[lid] = sum;
+            sycl::group_barrier(it.get_group());
+            auto add = [&](int32_t x, int32_t y, unsigned v) noexcept {
+                x -= tx;
+                y -= ty;
+                if (v == 0 || x < 0 || int32_t(t) <= x || y < 0 || int32_t(t) <= y) return ;
+                local_atomic(sums[y * t + x]).fetch_add(v);
+            };
+            for (auto k = offsets[bin] + lid, last = offsets[bin + 1]; k < last; k += w) {
+                auto e = entries[k];
+                if (e & tile_bins::segment_bit) {
+                    auto s = walk.screen_segment(e & ~tile_bins::segment_bit);
+                    auto x0 = std::max(real(tx), std::floor(std::min(s.ax, s.bx)) - 1);
+                    auto y0 = std::max(real(ty), std::floor(std::min(s.ay, s.by)) - 1);
+                    auto x1 = std::min(real(tx + int32_t(t) - 1), std::floor(std::max(s.ax, s.bx)) + 1);
+                    auto y1 = std::min(real(ty + int32_t(t) - 1), std::floor(std::max(s.ay, s.by)) + 1);
+                    if (x1 < x0 || y1 < y0) continue;
+                    for (auto y = static_cast<int32_t>(y0); y <= static_cast<int32_t>(y1); ++y) {
+                        for (auto x = static_cast<int32_t>(x0); x <= static_cast<int32_t>(x1); ++x) {
+                            add(x, y, s.coverage(x, y));
+                        }
+                    }
+                    continue;
+                }
+                auto [x, y, a, b, c, d] = walk.screen_taps(e);
+                add(x + 0, y + 0, a);
+                add(x + 0, y + 1, b);
+                add(x + 1, y + 0, c);
+                add(x + 1, y + 1, d);
+            }
+            sycl::group_barrier(it.get_group());
+            if (px < (int32_t) dim[1] && py < (int32_t) dim[0]) {
+                density[py * stride + px] = std::min(sums[lid], ceiling);
+            }
+        });
+    });
+    return events;
+}
+
+// binning() and splatting() back to back, waiting for the bins in between;
+// for callers with nothing else to do meanwhile.
+template <vertex_format_t F>
+auto rendering(sycl::queue& que,
+               uint32_t* density,
+               sycl::range<2> dim,
+               vertex_store<F> const& vertices,
+               tile_bins& bins,
+               viewport const& view,
+               std::vector<rect> const& damage,
+               splat_layer const* layer = nullptr) noexcept
+-> render_events
+{
+    auto events = binning(que, dim, vertices, bins, view, damage);
+    que.wait();
+    return splatting(que, density, dim, vertices, bins, view, events, layer);
+}
+
+// A horizontal band of the frame rendered on a queue of its own, typically
+// one per sub-device of a NUMA domain, with bins of its own.
+struct render_band {
+    sycl::queue* que;
+    tile_bins bins;
+
+    render_band(sycl::queue& que, sycl::range<2> dim) noexcept
+        : que{&que}, bins{que, dim}
+    {
+    }
+};
+
+// Rows [first, last) of band i of n over a frame of dim; bands are whole
+// rows of tiles, so no two of them write to the same tile.
+[[nodiscard]] inline std::pair<int32_t, int32_t> band_rows(size_t i, size_t n, sycl::range<2> dim) noexcept {
+    constexpr auto t = tile_bins::tile_size;
+    auto rows = ((dim[0] + t - 1) / t + n - 1) / n * t;
+    return {
+        static_cast<int32_t>(std::min(i * rows, dim[0])),
+        static_cast<int32_t>(std::min((i + 1) * rows, dim[0])),
+    };
+}
+
+// Queues to render on: the main one first, then one per band. "numa" makes a
+// band of every NUMA domain of device, a number n > 1 makes n bands on the
+// device itself, and anything else none at all. All the queues share one
+// context, so that memory allocated through any of them is reachable from
+// the others.
+[[nodiscard]] inline auto make_queues(sycl::device device, std::string_view bands, sycl::property_list const& props) noexcept
+-> std::vector<sycl::queue>
+{
+    std::vector<sycl::device> devices;
+    if (bands == "numa") {
+        try {
+            devices = device.create_sub_devices<sycl::info::partition_property::partition_by_affinity_domain>(
+                sycl::info::partition_affinity_domain::numa);
+        }
+        catch (sycl::exception& ex) {
+            std::cerr << "create_sub_devices failed: " << ex.what() << std::endl;
+        }
+        if (devices.size() < 2) devices.clear();
+    }
+    else {
+        int n = 0;
+        for (auto c : bands) n = '0' <= c && c <= '9' ? n * 10 + (c - '0') : 0;
+        if (n > 1) devices.assign(n, device);
+    }
+    std::vector<sycl::queue> ret;
+    ret.reserve(devices.size() + 1);
+    if (devices.empty()) {
+        ret.emplace_back(device, props);
+        return ret;
+    }
+    std::vector<sycl::device> all{device};
+    for (auto const& sub : devices) {
+        if (sub != device) all.push_back(sub);
+    }
+    sycl::context context{all};
+    ret.emplace_back(context, device, props);
+    for (auto const& sub : devices) ret.emplace_back(context, sub, props);
+    return ret;
+}
+
+// Writes zeros over the rows of density each band renders, from that band's
+// queue, so that on a first-touch system the pages of a band end up in the
+// memory of the domain rendering it.
+inline void first_touch(std::vector<std::unique_ptr<render_band>> const& bands,
+                        uint32_t* density,
+                        sycl::range<2> dim) noexcept
+{
+    for (size_t i = 0; i < bands.size(); ++i) {
+        auto [first, last] = band_rows(i, bands.size(), dim);
+        if (first == last) continue;
+        bands[i]->que->parallel_for((last - first) * dim[1], [=, offset = first * dim[1]](sycl::item<1> idx) noexcept {
+            density[offset + idx] = 0;
+        });
+    }
+    for (auto const& band : bands) band->que->wait();
+}
+
+// Makes the in-order que hold back whatever is submitted to it next until
+// events, which may be on other queues of its context, have completed,
+// without blocking the host. The event returned completes along with
+// everything submitted to que before.
+inline auto joining(sycl::queue& que, std::vector<sycl::event> const& events) noexcept {
+    return que.submit([&](sycl::handler& h) noexcept {
+        h.depends_on(events);
+        h.single_task([]() noexcept { });
+    });
+}
+
+// binning() split into bands, each on its own queue after uploaded, and
+// restricted to the damage in its rows, and so to the vertices that may land
+// there. The bands run concurrently; every band queue has to have completed
+// before banded_splatting().
+template <vertex_format_t F>
+auto banded_binning(std::vector<std::unique_ptr<render_band>>& bands,
+                    sycl::range<2> dim,
+                    vertex_store<F> const& vertices,
+                    viewport const& view,
+                    std::vector<rect> const& damage,
+                    sycl::event uploaded = {}) noexcept
+-> std::vector<render_events>
+{
+    std::vector<render_events> ret;
+    std::vector<rect> clipped;
+    for (size_t i = 0; i < bands.size(); ++i) {
+        auto [first, last] = band_rows(i, bands.size(), dim);
+        auto rows = rect{ 0, first, static_cast<int32_t>(dim[1]), last - first };
+        clipped.clear();
+        for (auto r : damage) {
+            if (auto c = intersected(r, rows); !c.empty()) clipped.push_back(c);
+        }
+        auto& band = *bands[i];
+        joining(*band.que, { uploaded });
+        ret.push_back(binning(*band.que, dim, vertices, band.bins, view, clipped));
+    }
+    return ret;
+}
+
+// splatting() of every band binned by banded_binning(), concurrently; events
+// are those it returned, and come back completed by the splats. Join the
+// splats before reading density on another queue.
+template <vertex_format_t F>
+void banded_splatting(std::vector<std::unique_ptr<render_band>>& bands,
+                      uint32_t* density,
+                      sycl::range<2> dim,
+                      vertex_store<F> const& vertices,
+                      viewport const& view,
+                      std::vector<render_events>& events,
+                      splat_layer const* layer = nullptr) noexcept
+{
+    for (size_t i = 0; i < bands.size(); ++i) {
+        auto& band = *bands[i];
+        events[i] = splatting(*band.que, density, dim, vertices, band.bins, view, events[i], layer);
+    }
+}
+
+// Both phases back to back, waiting for the bands in between and at the end,
+// with the events of each band. Whatever was submitted to the store's queue
+// must have completed.
+template <vertex_format_t F>
+auto banded_rendering(std::vector<std::unique_ptr<render_band>>& bands,
+                      uint32_t* density,
+                      sycl::range<2> dim,
+                      vertex_store<F> const& vertices,
+                      viewport const& view,
+                      std::vector<rect> const& damage,
+                      splat_layer const* layer = nullptr) noexcept
+-> std::vector<render_events>
+{
+    auto ret = banded_binning(bands, dim, vertices, view, damage);
+    for (auto const& band : bands) band->que->wait();
+    banded_splatting(bands, density, dim, vertices, view, ret, layer);
+    for (auto const& band : bands) band->que->wait();
+    return ret;
+}
+
+// How density maps to the grey level of a pixel.
+enum class tone_curve : uint32_t {
+    linear,    // one to one, clipping at 255 like a saturating add
+    log,       // log(1 + v), scaled so that the densest pixel is white
+    equalized, // by rank among the covered pixels (histogram equalization)
+};
+constexpr std::array<std::string_view, 3> tone_curve_names{ "linear", "log", "equalized" };
+
+// The curve called name; anything unrecognised is linear.
+[[nodiscard]] inline tone_curve parse_tone_curve(std::string_view name) noexcept {
+    auto found = std::ranges::find(tone_curve_names, name);
+    if (found == tone_curve_names.end()) return tone_curve::linear;
+    return static_cast<tone_curve>(found - tone_curve_names.begin());
+}
+
+// Lookup table from density to grey under the selected curve, rebuilt from
+// the density of the whole frame for the curves that depend on it. Densities
+// past the end of the table share its last entry. The table follows what is
+// drawn, not the cursor: the cursor vertex's own splat moves with every
+// pointer event, and folding it in would remap the whole frame each time for
+// the sake of four pixels.
+struct tone_map {
+    static constexpr uint32_t size = 1 << 16;
+    tone_curve curve = tone_curve::linear;
+    usm_unique_ptr<uint32_t> histogram; // one extra entry for the maximum density
+    usm_unique_ptr<uint32_t> ranks;     // exclusive scan of histogram
+    usm_unique_ptr<uint8_t> lut;
+    std::optional<tone_curve> built;    // curve of lut, if any
+
+    explicit tone_map(sycl::queue& que) noexcept
+        : histogram{malloc_device_unique<uint32_t>(size + 1, que)},
+          ranks{malloc_device_unique<uint32_t>(size, que)},
+          lut{malloc_device_unique<uint8_t>(size, que)}
+    {
+    }
+    explicit operator bool() const noexcept {
+        return this->histogram && this->ranks && this->lut;
+    }
+    // Rebuilds the table for density over dim if the curve changed, or if it
+    // depends on the density and reshaped says that rendering changed it.
+    // Returns whether it did, in which case every pixel has to be mapped
+    // again; the table itself never leaves the device.
+    [[nodiscard]] bool update(sycl::queue& que, uint32_t const* density, sycl::range<2> dim, bool reshaped) noexcept {
+        if (this->built == this->curve && (this->curve == tone_curve::linear || !reshaped)) return false;
+        auto curve = this->curve;
+        auto histogram = this->histogram.get();
+        auto ranks = this->ranks.get();
+        auto lut = this->lut.get();
+        auto pixels = static_cast<uint32_t>(dim.size());
+        if (curve != tone_curve::linear) {
+            que.memset(histogram, 0, (size + 1) * sizeof (uint32_t));
+            que.parallel_for(dim.size(), [=](sycl::item<1> idx) noexcept {
+                auto v = std::min(density[idx], size - 1);
+                sycl::atomic_ref<uint32_t,
+                                 sycl::memory_order::relaxed,
+                                 sycl::memory_scope::device>(histogram[v]).fetch_add(1u);
+                sycl::atomic_ref<uint32_t,
+                                 sycl::memory_order::relaxed,
+                                 sycl::memory_scope::device>(histogram[size]).fetch_max(v);
+            });
+        }
+        if (curve == tone_curve::equalized) {
+            que.parallel_for(sycl::nd_range<1>(256, 256), [=](sycl::nd_item<1> it) noexcept {
+                sycl::joint_exclusive_scan(it.get_group(), histogram, histogram + size, ranks, sycl::plus<uint32_t>{});
+            });
+        }
+        que.parallel_for(size, [=](sycl::item<1> idx) noexcept {
+            auto v = static_cast<uint32_t>(idx.get_linear_id());
+            float grey = 0;
+            if (curve == tone_curve::linear) {
+                grey = v;
+            }
+            else if (curve == tone_curve::log) {
+                if (auto top = histogram[size]) grey = 255 * std::log1p(float(v)) / std::log1p(float(top));
+            }
+            else if (auto covered = pixels - histogram[0]; v && covered) {
+                // Covered pixels no denser than v, as a fraction of all covered pixels.
+                grey = 255.0f * (ranks[v] + histogram[v] - histogram[0]) / covered;
+            }
+            lut[v] = static_cast<uint8_t>(std::min(grey, 255.0f));
+        });
+        this->built = curve;
+        return true;
+    }
+};
+
+// Maps the density of every pixel in damage through tones into pixels (rows
+// of pitch pixels in format P), over the background and the crosshair at
+// cursor, in a single kernel.
+template <pixel_format_t P>
+inline auto tone_mapping(sycl::queue& que,
+                         typename P::pixel* pixels,
+                         size_t pitch,
+                         sycl::range<2> dim,
+                         uint32_t const* density,
+                         tone_map const& tones,
+                         std::complex<double> cursor,
+                         std::vector<rect> const& damage) noexcept
+-> sycl::event
+{
+    auto bounds = rect{ 0, 0, static_cast<int32_t>(dim[1]), static_cast<int32_t>(dim[0]) };
+    // The rects and the index of the first pixel of each, so that a work-item
+    // can find its pixel.
+    std::array<rect, max_damage_rects> rects;
+    std::array<uint32_t, max_damage_rects + 1> firsts{};
+    size_t n = 0;
+    auto add = [&](rect r) noexcept {
+        r = intersected(r, bounds);
+        if (r.empty()) return ;
+        rects[n] = r;
+        firsts[n + 1] = firsts[n] + r.cx * r.cy;
+        ++n;
+    };
+    if (damage.size() <= max_damage_rects) {
+        for (auto r : damage) add(r);
+    }
+    else {
+        add(std::accumulate(damage.begin(), damage.end(), rect{}, united));
+    }
+    if (n == 0) return {};
+    // The crosshair covers the row and column the cursor sits exactly on.
+    auto on_grid = [](double v) noexcept {
+        return v == std::floor(v) && 0 <= v && v < std::numeric_limits<int32_t>::max() ? int32_t(v) : -1;
+    };
+    auto cross_x = on_grid(cursor.real());
+    auto cross_y = on_grid(cursor.imag());
+    auto lut = tones.lut.get();
+    auto stride = dim[1];
+    typename P::pixel background = 0;
+    typename P::pixel crosshair = 0;
+    assign<P>(background, 0xcc, 0, 0, 0);
+    assign<P>(crosshair, 0xcc, 0xff, 0xff, 0xff);
+    return que.parallel_for(firsts[n], [=](sycl::item<1> idx) noexcept {
+        auto k = static_cast<uint32_t>(idx.get_linear_id());
+        size_t i = 0;
+        while (firsts[i + 1] <= k) ++i;
+        auto r = rects[i];
+        auto px = r.x + static_cast<int32_t>((k - firsts[i]) % r.cx);
+        auto py = r.y + static_cast<int32_t>((k - firsts[i]) / r.cx);
+        auto pixel = (cross_x == px || cross_y == py) ? crosshair : background;
+        auto v = lut[std::min(density[py * stride + px], tone_map::size - 1)];
+        pixels[py * pitch + px] = assign<P>(pixel, 0, v, v, v);
+    });
+}
+
+// Copies the rows of framebuffer spanned by damage into pixels with a single
+// transfer; both have rows of pitch pixels in format P.
+template <pixel_format_t P>
+inline auto presenting(sycl::queue& que,
+                       typename P::pixel const* framebuffer,
+                       typename P::pixel* pixels,
+                       size_t pitch,
+                       sycl::range<2> dim,
+                       std::vector<rect> const& damage) noexcept
+-> sycl::event
+{
+    auto bounds = rect{ 0, 0, static_cast<int32_t>(dim[1]), static_cast<int32_t>(dim[0]) };
+    auto rows = intersected(std::accumulate(damage.begin(), damage.end(), rect{}, united), bounds);
+    if (rows.empty()) return {};
+    auto offset = rows.y * pitch;
+    return que.memcpy(pixels + offset, framebuffer + offset, rows.cy * pitch * sizeof (typename P::pixel));
+}
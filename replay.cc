@@ -0,0 +1,208 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <complex>
+
+#include <CL/sycl.hpp>
+
+#include "environment.hh"
+#include "rendering.hh"
+#include "scene.hh"
+#include "metrics.hh"
+#include "frame.hh"
+#include "streaming.hh"
+
+// Replays an input log recorded with GRAPHIO_RECORD through the scene and
+// the renderer, without a compositor: events are applied as they were, and a
+// frame is drawn into an ordinary host buffer wherever the session drew one,
+// by the same draw_frame() as graphio's.
+// Prints one JSON object with the frame times and a checksum over every
+// frame, which stays put from run to run unless the output changes.
+// The vertex format, tone curve, pixel format and point file are those the
+// log records, and the point layer is drawn under the frames that drew it.
+// Logs that record no session are drawn in argb8888 without points, with
+// GRAPHIO_VERTICES and GRAPHIO_TONE honoured as by graphio itself.
+
+inline namespace replay_helper
+{
+    struct options {
+        std::string log;
+        bool realtime = false;     // keep the recorded pace instead of going flat out
+        std::string expect;        // checksum to compare against, if any
+    };
+
+    [[nodiscard]] bool parse(int argc, char** argv, options& opts) noexcept {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            std::string_view key = argv[i];
+            std::string_view value = argv[i + 1];
+            if (key == "--log") {
+                opts.log = value;
+            }
+            else if (key == "--pace") {
+                if (value != "fast" && value != "realtime") return false;
+                opts.realtime = value == "realtime";
+            }
+            else if (key == "--expect") {
+                opts.expect = value;
+            }
+            else {
+                return false;
+            }
+        }
+        return argc % 2 == 1 && !opts.log.empty();
+    }
+} // ::replay_helper
+
+int main(int argc, char** argv) {
+    options opts;
+    if (!parse(argc, argv, opts)) {
+        std::cerr << "usage: " << argv[0] << " --log <file> [--pace fast|realtime] [--expect <checksum>]" << std::endl;
+        return 1;
+    }
+    auto log = read_input_log(opts.log.c_str());
+    if (!log) return 1;
+    auto const& session = log->session;
+    auto const& events = log->events;
+    if (!log->versioned) {
+        std::cerr << opts.log << " records no session; replaying it with the environment's..." << std::endl;
+    }
+    sycl::queue que{sycl::property::queue::in_order{}};
+    std::string_view format = log->versioned ? std::string_view(session.vertices) : environment("GRAPHIO_VERTICES");
+    if (format.empty()) {
+        format = que.get_device().has(sycl::aspect::fp64) ? fp64::name : fp32::name;
+    }
+    if (log->versioned && format != fp64::name && format != fp32::name && format != fixed16::name) {
+        std::cerr << opts.log << " was drawn in " << format << ", which is unknown..." << std::endl;
+        return 1;
+    }
+    if (format == fp64::name && !que.get_device().has(sycl::aspect::fp64)) {
+        std::cerr << opts.log << " was drawn in fp64, which this device lacks..." << std::endl;
+        return 1;
+    }
+    std::vector<uint32_t> every;
+    [&]<size_t... I>(std::index_sequence<I...>) noexcept {
+        (every.push_back(std::variant_alternative_t<I, any_pixel_format>::shm_format), ...);
+    }(std::make_index_sequence<std::variant_size_v<any_pixel_format>>{});
+    std::string_view pixels_name = session.pixels.empty() ? argb8888::name : session.pixels;
+    auto pixel_format = make_pixel_format(pixels_name, every);
+    if (std::visit([](auto format) noexcept { return std::string_view(decltype (format)::name); }, *pixel_format) != pixels_name) {
+        std::cerr << opts.log << " was drawn in " << pixels_name << ", which is unknown..." << std::endl;
+        return 1;
+    }
+    std::unique_ptr<point_file> points;
+    if (!session.points.empty()) {
+        points = map_point_file(session.points.c_str(), que);
+        if (!points) return 1;
+    }
+    scene scene;
+    if (log->versioned) scene.curve = parse_tone_curve(session.tone);
+    else if (auto name = environment("GRAPHIO_TONE"); !name.empty()) scene.curve = parse_tone_curve(name);
+    scene.invalidate({ 0, 0, scene.cx, scene.cy });
+    auto store = make_vertex_store(format, que);
+    tile_bins bins{que, sycl::range<2>(scene.cy, scene.cx)};
+    tone_map tones{que};
+    if (!bins || !tones) {
+        std::cerr << "allocation failed..." << std::endl;
+        return 1;
+    }
+    splat_layer layer{que};
+    std::vector<std::unique_ptr<render_band>> bands;
+    frame_trace trace{nullptr};
+    auto drawer = renderer{ &que, &bands, &store, &bins, &tones, nullptr, &trace };
+    usm_unique_ptr<uint32_t> density{nullptr, usm_deleter{&que}};
+    usm_unique_ptr<uint32_t> framebuffer{nullptr, usm_deleter{&que}};
+    std::vector<uint32_t> pixels;
+    size_t capacity = 0;
+    bool direct = que.get_device().has(sycl::aspect::usm_system_allocations);
+    uint64_t hash = checksum_basis;
+    size_t frames = 0;
+    stats frame;
+    auto started = std::chrono::steady_clock::now();
+    for (auto const& ev : events) {
+        if (opts.realtime) std::this_thread::sleep_until(started + std::chrono::nanoseconds(ev.time));
+        if (ev.kind != input_kind::frame) {
+            scene.apply(ev);
+            if (scene.quit) break;
+            continue;
+        }
+        // A frame as windowing() draws it, at the size it was drawn at.
+        auto f0 = std::chrono::steady_clock::now();
+        auto cx = ev.x;
+        auto cy = ev.y;
+        auto dim = sycl::range<2>(cy, cx);
+        if (capacity < dim.size()) {
+            capacity = std::max(dim.size(), 2 * capacity);
+            density = malloc_device_unique<uint32_t>(capacity, que);
+            if (!direct) framebuffer = malloc_device_unique<uint32_t>(capacity, que);
+            if (!density || (!direct && !framebuffer)) {
+                std::cerr << "sycl::malloc_device failed..." << std::endl;
+                return 1;
+            }
+            pixels.resize(capacity);
+        }
+        // The layer as the session streamed it, for the view of the frame.
+        drawer.layer = nullptr;
+        if (ev.state & 1) {
+            if (!points) {
+                std::cerr << opts.log << " drew a point layer but records no point file..." << std::endl;
+                return 1;
+            }
+            if (layer.view != scene.view || layer.dim[0] < dim[0] || layer.dim[1] < dim[1]) {
+                auto extent = sycl::range<2>(std::max(layer.dim[0], dim[0]), std::max(layer.dim[1], dim[1]));
+                auto ok = std::visit([&](auto const& store) noexcept {
+                    using F = typename std::remove_cvref_t<decltype (store)>::format;
+                    point_stream<F> stream{que, *points, layer, extent, scene.view};
+                    if (!stream) return false;
+                    while (stream.step(que)) que.wait();
+                    return true;
+                }, store);
+                if (!ok) return 1;
+            }
+            drawer.layer = &layer;
+        }
+        size_t words = 0;
+        auto present = [&](std::vector<rect> const& damage, std::complex<double> cursor, bool) noexcept {
+            std::visit([&](auto format) noexcept {
+                using P = decltype (format);
+                using pixel = typename P::pixel;
+                auto pitch = row_pitch<P>(cx);
+                auto target = reinterpret_cast<pixel*>(framebuffer ? framebuffer.get() : pixels.data());
+                tone_mapping<P>(que, target, pitch, dim, density.get(), tones, cursor, damage);
+                if (framebuffer) {
+                    presenting<P>(que, target, reinterpret_cast<pixel*>(pixels.data()), pitch, dim, damage);
+                }
+                words = pitch * dim[0] * sizeof (pixel) / sizeof (uint32_t);
+            }, *pixel_format);
+            return true;
+        };
+        if (!draw_frame(drawer, scene, density.get(), dim, blocking, present)()) return 1;
+        trace.end_frame();
+        frame.samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - f0).count());
+        hash = checksum(hash, pixels.data(), words);
+        ++frames;
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "{\"log\":\"" << opts.log << "\",\"format\":\"" << format << "\",\"pixels\":\"" << pixels_name
+              << "\",\"pace\":\"" << (opts.realtime ? "realtime" : "fast")
+              << "\",\"events\":" << events.size() << ",\"frames\":" << frames
+              << ",\"elapsed_ms\":" << elapsed << ",\"frame_ms\":";
+    frame.print(std::cout);
+    std::ostringstream digest;
+    digest << std::hex << hash;
+    std::cout << ",\"checksum\":\"" << digest.str() << '"';
+    bool matched = true;
+    if (!opts.expect.empty()) {
+        matched = opts.expect == digest.str();
+        std::cout << ",\"expected\":\"" << opts.expect << "\",\"match\":" << (matched ? "true" : "false");
+    }
+    std::cout << '}' << std::endl;
+    return matched ? 0 : 2;
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <complex>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rendering.hh"
+
+#include <wayland-client.h>
+#include <linux/input-event-codes.h>
+
+// One input event as the scene sees it, and as it is logged: 24 bytes in
+// host byte order. Pointer positions and axis values are wl_fixed_t.
+enum class input_kind : uint16_t {
+    motion,    // x, y
+    button,    // code, state
+    axis,      // code, x
+    key,       // code, state
+    configure, // x, y: the new surface size
+    frame,     // x, y: the size a frame was committed at; state: 1 if it drew the point layer
+};
+struct input_event {
+    uint64_t time = 0; // ns since recording started
+    input_kind kind;
+    uint16_t state = 0;
+    uint32_t code = 0;
+    int32_t x = 0;
+    int32_t y = 0;
+};
+static_assert(sizeof (input_event) == 24);
+
+// A log is the magic, the session it was recorded in as a 32-bit byte count
+// and that many bytes of "key=value" lines, and the events. Logs of the first
+// version have the older magic and no session.
+constexpr std::array<char, 8> input_log_magic{ 'g', 'r', 'a', 'p', 'h', 'i', 'o', '2' };
+constexpr std::array<char, 8> input_log_magic_v1{ 'g', 'r', 'a', 'p', 'h', 'i', 'o', '1' };
+
+// What a session was drawn with besides its input, by name; empty where not
+// known.
+struct session_config {
+    std::string vertices; // vertex format
+    std::string tone;     // tone curve at the start
+    std::string pixels;   // pixel format
+    std::string points;   // point file, if any
+
+    [[nodiscard]] std::string text() const {
+        return "vertices=" + this->vertices + "\ntone=" + this->tone +
+               "\npixels=" + this->pixels + "\npoints=" + this->points + "\n";
+    }
+    // Unknown keys are skipped, for logs of later sessions.
+    [[nodiscard]] static session_config parse(std::string_view text) {
+        session_config ret;
+        while (!text.empty()) {
+            auto line = text.substr(0, text.find('\n'));
+            text.remove_prefix(std::min(text.size(), line.size() + 1));
+            auto eq = line.find('=');
+            if (eq == line.npos) continue;
+            auto key = line.substr(0, eq);
+            auto value = std::string(line.substr(eq + 1));
+            if (key == "vertices") ret.vertices = value;
+            else if (key == "tone") ret.tone = value;
+            else if (key == "pixels") ret.pixels = value;
+            else if (key == "points") ret.points = value;
+        }
+        return ret;
+    }
+};
+
+// Logs every event passed to record(), stamped on steady_clock and written in
+// batches, after the session. Records nothing when path is null or empty.
+struct input_recorder {
+    static constexpr size_t batch = 1024;
+    std::ofstream output;
+    uint64_t origin = 0;
+    std::vector<input_event> pending;
+
+    input_recorder(char const* path, session_config const& session) noexcept {
+        if (!path || !*path) return;
+        this->output.open(path, std::ios::binary | std::ios::trunc);
+        if (!this->output) {
+            std::cerr << "Cannot open " << path << "..." << std::endl;
+            return;
+        }
+        auto text = session.text();
+        auto size = static_cast<uint32_t>(text.size());
+        this->output.write(input_log_magic.data(), input_log_magic.size());
+        this->output.write(reinterpret_cast<char const*>(&size), sizeof size);
+        this->output.write(text.data(), size);
+        this->origin = now();
+        this->pending.reserve(batch);
+    }
+    input_recorder(input_recorder const&) = delete;
+    ~input_recorder() noexcept { this->flush(); }
+    explicit operator bool() const noexcept { return this->output.is_open() && bool(this->output); }
+
+    [[nodiscard]] static uint64_t now() noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    void record(input_event ev) noexcept {
+        if (!*this) return;
+        ev.time = now() - this->origin;
+        this->pending.push_back(ev);
+        if (this->pending.size() == batch) this->flush();
+    }
+    void flush() noexcept {
+        if (this->pending.empty() || !*this) return;
+        this->output.write(reinterpret_cast<char const*>(this->pending.data()),
+                           this->pending.size() * sizeof (input_event));
+        this->output.flush();
+        this->pending.clear();
+    }
+};
+
+// A log written by input_recorder.
+struct input_log {
+    session_config session;
+    bool versioned = false; // whether it recorded its session
+    std::vector<input_event> events;
+};
+
+[[nodiscard]] inline auto read_input_log(char const* path) noexcept
+-> std::optional<input_log>
+{
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        std::cerr << "Cannot open " << path << "..." << std::endl;
+        return std::nullopt;
+    }
+    std::array<char, input_log_magic.size()> magic;
+    if (!input.read(magic.data(), magic.size()) || (magic != input_log_magic && magic != input_log_magic_v1)) {
+        std::cerr << path << " is not an input log..." << std::endl;
+        return std::nullopt;
+    }
+    input_log ret;
+    if (magic == input_log_magic) {
+        uint32_t size = 0;
+        std::string text;
+        if (input.read(reinterpret_cast<char*>(&size), sizeof size)) text.resize(size);
+        if (!input || !input.read(text.data(), size)) {
+            std::cerr << path << " is truncated..." << std::endl;
+            return std::nullopt;
+        }
+        ret.session = session_config::parse(text);
+        ret.versioned = true;
+    }
+    input_event ev;
+    while (input.read(reinterpret_cast<char*>(&ev), sizeof ev)) ret.events.push_back(ev);
+    return ret;
+}
+
+// What is drawn. Input only changes it through apply(), so replaying a log
+// reproduces a session.
+struct scene {
+    int32_t cx = 1024;                  // surface size, as last configured
+    int32_t cy = 768;
+    viewport view;                      // of the world the store and the point file live in
+    std::complex<double> cursor;        // in surface pixels, like everything below
+    std::complex<double> crosshair;     // cursor as of the last commit
+    bool dragging = false;
+    std::vector<primitive> primitives;  // added since the last frame, not yet on the device
+    std::vector<segment> segments;      // likewise
+    std::vector<rect> damage;           // changed since the last commit
+    bool reshaped = true;               // density changed beyond the cursor since the last commit
+    bool dirty = true;                  // needs a new frame
+    tone_curve curve = tone_curve::linear;
+    bool quit = false;
+    input_recorder* recorder = nullptr; // logs every event applied, if set
+
+    void invalidate(rect r) noexcept {
+        accumulate_damage(this->damage, r);
+        this->dirty = true;
+    }
+    // Anything drawn, as opposed to the cursor, reshapes the density.
+    void reshape(rect r) noexcept {
+        this->invalidate(r);
+        this->reshaped = true;
+    }
+    void add(primitive p) {
+        this->primitives.push_back(p);
+        this->reshape(this->view.to_screen(footprint(p)));
+    }
+    void add(segment s) {
+        this->segments.push_back(s);
+        this->reshape(this->view.to_screen(footprint(s)));
+    }
+    // Everything moves on screen, so the whole frame is damaged.
+    void look(viewport view) noexcept {
+        if (view == this->view) return;
+        this->view = view;
+        this->reshape({ 0, 0, this->cx, this->cy });
+    }
+    void resize(int32_t cx, int32_t cy) noexcept {
+        if (cx == this->cx && cy == this->cy) return;
+        this->cx = cx;
+        this->cy = cy;
+        this->reshape({ 0, 0, cx, cy });
+    }
+    // Damages the crosshair row/column and the cursor vertex's own splat at
+    // both the last committed and the current cursor position.
+    void track_cursor() noexcept {
+        if (this->cursor == this->crosshair) return;
+        for (auto pt : { this->crosshair, this->cursor }) {
+            auto fp = footprint(std::array{pt});
+            this->invalidate({ 0, fp.y, this->cx, 2 });
+            this->invalidate({ fp.x, 0, 2, this->cy });
+        }
+        this->crosshair = this->cursor;
+    }
+
+    void apply(input_event const& ev) {
+        if (this->recorder) this->recorder->record(ev);
+        switch (ev.kind) {
+        case input_kind::motion: {
+            auto cursor = std::complex<double>{ wl_fixed_to_double(ev.x), wl_fixed_to_double(ev.y) };
+            if (this->dragging) {
+                auto view = this->view;
+                view.pan(cursor - this->cursor);
+                this->look(view);
+            }
+            this->cursor = cursor;
+            this->dirty = true;
+            break;
+        }
+        case input_kind::button:
+            if (ev.code == BTN_LEFT) {
+                this->dragging = ev.state;
+            }
+            else if (ev.code == BTN_RIGHT && ev.state) {
+                // A golden-angle spiral around the click and lines to it from
+                // the two top corners. Only the descriptors are kept; the
+                // vertices are generated on the device with the next frame.
+                auto pt = this->view.to_world(this->cursor);
+                auto left = this->view.to_world({ 0, 0 });
+                auto right = this->view.to_world({ double(this->cx), 0 });
+                this->add(primitive{ primitive::spiral, 64, pt.real(), pt.imag() });
+                this->add(segment{ left.real(), left.imag(), pt.real(), pt.imag() });
+                this->add(segment{ pt.real(), pt.imag(), right.real(), right.imag() });
+            }
+            break;
+        case input_kind::axis:
+            // Zooms around the cursor, by a factor of two every four notches.
+            if (ev.code == WL_POINTER_AXIS_VERTICAL_SCROLL) {
+                auto view = this->view;
+                view.zoom(this->cursor, std::exp2(-wl_fixed_to_double(ev.x) / 40));
+                this->look(view);
+            }
+            break;
+        case input_kind::key:
+            if (ev.state == 0 && (ev.code == 1 || ev.code == 16)) {
+                this->quit = true;
+            }
+            else if (ev.state == 0 && ev.code == KEY_T) {
+                // Only the mapping changes; the accumulated density is kept.
+                auto next = (static_cast<size_t>(this->curve) + 1) % tone_curve_names.size();
+                this->curve = static_cast<tone_curve>(next);
+                this->dirty = true;
+            }
+            break;
+        case input_kind::configure:
+            if (0 < ev.x && 0 < ev.y) this->resize(ev.x, ev.y);
+            break;
+        case input_kind::frame:
+            break;
+        }
+    }
+};
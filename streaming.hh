@@ -0,0 +1,212 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include <CL/sycl.hpp>
+
+#include "rendering.hh"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// A recorded point cloud of interleaved (x, y) doubles in world coordinates,
+// mapped read-only, with what streams of it keep from one to the next: the
+// staging buffers and bins, and the box of every chunk read so far, with
+// which later streams skip the chunks outside their view.
+struct point_file {
+    static constexpr size_t chunk = size_t(1) << 20; // points
+    void* data = MAP_FAILED;
+    size_t size = 0;  // bytes
+    size_t count = 0; // points
+    std::vector<std::array<double, 4>> boxes; // min x, min y, max x, max y per chunk; empty until read
+    usm_unique_ptr<double> staging;           // a chunk of x, then y, in any vertex format
+    usm_unique_ptr<double> coords;            // and on the device
+    tile_bins bins;
+
+    explicit point_file(sycl::queue& que) noexcept
+        : staging{sycl::malloc_host<double>(2 * chunk, que), usm_deleter{&que}},
+          coords{malloc_device_unique<double>(2 * chunk, que)},
+          bins{que, sycl::range<2>(tile_bins::tile_size, tile_bins::tile_size)}
+    {
+    }
+    point_file(point_file const&) = delete;
+    ~point_file() noexcept {
+        if (this->data != MAP_FAILED) munmap(this->data, this->size);
+    }
+    explicit operator bool() const noexcept {
+        return this->staging && this->coords && this->bins;
+    }
+    [[nodiscard]] double const* points() const noexcept {
+        return reinterpret_cast<double const*>(this->data);
+    }
+    [[nodiscard]] size_t chunks() const noexcept {
+        return (this->count + chunk - 1) / chunk;
+    }
+    [[nodiscard]] bool known(size_t k) const noexcept {
+        return this->boxes[k][0] <= this->boxes[k][2];
+    }
+};
+
+// Whether splats of points within box (min x, min y, max x, max y in world
+// coordinates) may land in the screen pixels of region under view.
+[[nodiscard]] inline bool in_view(std::array<double, 4> const& box, viewport const& view, rect region) noexcept {
+    // Splats reach a pixel past the points; one more keeps clear of rounding.
+    auto lo = view.to_world({ region.x - 2.0, region.y - 2.0 });
+    auto hi = view.to_world({ region.x + region.cx + 2.0, region.y + region.cy + 2.0 });
+    return box[0] <= hi.real() && lo.real() <= box[2] && box[1] <= hi.imag() && lo.imag() <= box[3];
+}
+
+[[nodiscard]]
+inline auto map_point_file(char const* path, sycl::queue& que) noexcept
+-> std::unique_ptr<point_file>
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Cannot open " << path << "..." << std::endl;
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < 0) {
+        std::cerr << "fstat failed..." << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    auto ret = std::make_unique<point_file>(que);
+    if (!*ret) {
+        std::cerr << "sycl::malloc failed..." << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    ret->size = st.st_size;
+    ret->count = ret->size / (2 * sizeof (double));
+    ret->boxes.assign(ret->chunks(), { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                                       std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() });
+    if (ret->count == 0) {
+        close(fd);
+        return ret;
+    }
+    ret->data = mmap(nullptr, ret->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ret->data == MAP_FAILED) {
+        std::cerr << "mmap failed..." << std::endl;
+        return nullptr;
+    }
+    madvise(ret->data, ret->size, MADV_SEQUENTIAL);
+    return ret;
+}
+
+// Sums the splats of the points of file in view over a frame of dim into
+// layer, through binning() and splatting() like the vertices of a frame, a
+// step() at a time: a host task reads the next chunk in view from the
+// mapping into the staging buffer, in world coordinates and format F, and
+// the chunk is copied to the device and binned under view; the next step
+// splats it. The queue has to drain between steps.
+template <vertex_format_t F>
+struct point_stream {
+    using scalar = typename F::scalar;
+    static_assert(sizeof (scalar) <= sizeof (double));
+    static constexpr size_t chunk = point_file::chunk;
+    point_file* file;
+    splat_layer* layer;
+    viewport view;
+    rect frame;
+    render_events events;
+    size_t next = 0;     // chunk of the file to read next
+    bool binned = false; // the chunk read last is binned, and splats next
+
+    point_stream(sycl::queue& que,
+                 point_file& file,
+                 splat_layer& layer,
+                 sycl::range<2> dim,
+                 viewport const& view) noexcept
+        : file{&file}, layer{&layer}, view{view},
+          frame{ 0, 0, static_cast<int32_t>(dim[1]), static_cast<int32_t>(dim[0]) }
+    {
+        if (!file.bins.resize(que, dim)) return ;
+        if (layer.capacity < dim.size()) {
+            layer.sums = malloc_unique<uint32_t>(dim.size(), que, layer.kind);
+            if (!layer.sums) {
+                std::cerr << "sycl::malloc failed..." << std::endl;
+                layer.capacity = 0;
+                return ;
+            }
+            layer.capacity = dim.size();
+        }
+        layer.dim = dim;
+        layer.view = view;
+        que.memset(layer.sums.get(), 0, dim.size() * sizeof (uint32_t));
+        // Every chunk lands anywhere in the frame.
+        file.bins.mark({ this->frame }, this->frame);
+    }
+    explicit operator bool() const noexcept {
+        return this->file->bins && this->layer->sums;
+    }
+    // Submits the next half of the work on the next chunk in view; false
+    // once there was nothing left to submit.
+    [[nodiscard]] bool step(sycl::queue& que) noexcept {
+        auto& file = *this->file;
+        auto& bins = file.bins;
+        auto xs = reinterpret_cast<scalar*>(file.coords.get());
+        auto walk = vertex_walk<F>{xs, xs + chunk, bins, this->view};
+        if (this->binned) {
+            // Adds to what the layer holds, and stops far beyond what a pixel
+            // can show, before wrapping around.
+            splatting(que, this->layer->sums.get(), this->layer->dim, walk, bins, this->events,
+                      this->layer, splat_layer::saturation);
+            this->binned = false;
+            return true;
+        }
+        while (this->next < file.chunks() && file.known(this->next) &&
+               !in_view(file.boxes[this->next], this->view, this->frame))
+        {
+            ++this->next;
+        }
+        if (this->next == file.chunks()) return false;
+        auto k = this->next++;
+        auto count = std::min(chunk, file.count - k * chunk);
+        que.submit([&](sycl::handler& h) noexcept {
+            auto src = file.points() + 2 * k * chunk;
+            auto dst = reinterpret_cast<scalar*>(file.staging.get());
+            auto box = &file.boxes[k];
+            h.host_task([=]() noexcept { load(src, count, dst, box); });
+        });
+        que.memcpy(xs, file.staging.get(), count * sizeof (scalar));
+        que.memcpy(xs + chunk, reinterpret_cast<scalar*>(file.staging.get()) + chunk, count * sizeof (scalar));
+        auto n = static_cast<uint32_t>(count);
+        bins.runs.assign(1, vertex_run{ 0, n, 0, 0 });
+        que.memcpy(bins.runs_dev.get(), bins.runs.data(), sizeof (vertex_run));
+        this->events = binning(que, this->layer->dim, walk, bins, bins.dirty.size(), n, n, this->frame);
+        this->binned = true;
+        return true;
+    }
+
+private:
+    // Encodes the count points at src into dst, x then y, notes their box, and
+    // lets go of their pages; runs on a thread of the SYCL runtime.
+    static void load(double const* src, size_t count, scalar* dst, std::array<double, 4>* box) noexcept {
+        std::array<double, 4> ret{ std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                                   std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+        for (size_t k = 0; k < count; ++k) {
+            auto x = src[2*k + 0];
+            auto y = src[2*k + 1];
+            ret = { std::min(ret[0], x), std::min(ret[1], y), std::max(ret[2], x), std::max(ret[3], y) };
+            dst[k] = F::encode(x);
+            dst[chunk + k] = F::encode(y);
+        }
+        *box = ret;
+        auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        auto begin = reinterpret_cast<uintptr_t>(src) / page * page;
+        auto end = reinterpret_cast<uintptr_t>(src + 2 * count) / page * page;
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+    }
+};
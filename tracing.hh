@@ -0,0 +1,137 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <CL/sycl.hpp>
+
+// Per-frame stage timings in a fixed-size ring; host stages on steady_clock,
+// device stages from event profiling. Disabled when path is empty.
+struct frame_trace {
+    struct span {
+        char const* name; // string literal
+        uint64_t begin;   // ns on the host steady clock
+        uint64_t end;
+        uint32_t frame;
+        bool device;
+    };
+    static constexpr size_t capacity = 1 << 14;
+    static constexpr uint32_t summary_interval = 120;
+
+    std::string path;
+    std::vector<span> ring;
+    size_t recorded = 0;
+    uint32_t frame = 0;
+    uint64_t submitted = 0; // ns, as of begin_frame()
+    std::vector<std::pair<char const*, sycl::event>> pending;
+
+    explicit frame_trace(char const* path) noexcept {
+        if (path && *path) {
+            this->path = path;
+            this->ring.resize(capacity);
+            this->reserve(0);
+        }
+    }
+    [[nodiscard]] bool enabled() const noexcept { return !this->ring.empty(); }
+    // Four kernels per band (or one set unbanded), plus tone and present.
+    void reserve(size_t bands) noexcept {
+        if (this->enabled()) this->pending.reserve(4 * std::max<size_t>(bands, 1) + 2);
+    }
+
+    [[nodiscard]] static uint64_t now() noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    void host(char const* name, uint64_t begin, uint64_t end = now()) noexcept {
+        if (!this->enabled()) return;
+        this->ring[this->recorded++ % capacity] = { name, begin, end, this->frame, false };
+    }
+    // Read in end_frame().
+    void device(char const* name, sycl::event const& event) noexcept {
+        if (!this->enabled()) return;
+        this->pending.emplace_back(name, event);
+    }
+    uint64_t begin_frame() noexcept {
+        return this->submitted = now();
+    }
+    // Aligns the device stages on the host clock from begin_frame().
+    void end_frame() noexcept {
+        if (!this->enabled()) return;
+        // Skipped stages have no profiling info.
+        uint64_t origin = 0;
+        for (auto const& [name, event] : this->pending) {
+            try {
+                auto queued = event.get_profiling_info<sycl::info::event_profiling::command_submit>();
+                if (origin == 0 || queued < origin) origin = queued;
+            }
+            catch (sycl::exception&) {
+            }
+        }
+        for (auto const& [name, event] : this->pending) {
+            try {
+                auto begin = event.get_profiling_info<sycl::info::event_profiling::command_start>();
+                auto end = event.get_profiling_info<sycl::info::event_profiling::command_end>();
+                this->ring[this->recorded++ % capacity] = {
+                    name, begin - origin + this->submitted, end - origin + this->submitted, this->frame, true
+                };
+            }
+            catch (sycl::exception&) {
+            }
+        }
+        this->pending.clear();
+        if (++this->frame % summary_interval == 0) this->summary(std::cout);
+    }
+
+    // Mean and worst duration of every stage over the last summary_interval frames.
+    void summary(std::ostream& output) const {
+        struct total { char const* name; bool device; double sum; double max; uint32_t n; };
+        std::vector<total> totals;
+        for (size_t i = this->recorded - std::min(this->recorded, capacity); i < this->recorded; ++i) {
+            auto const& s = this->ring[i % capacity];
+            if (s.frame + summary_interval < this->frame) continue;
+            auto found = std::find_if(totals.begin(), totals.end(), [&](auto const& t) noexcept {
+                return t.device == s.device && std::strcmp(t.name, s.name) == 0;
+            });
+            if (found == totals.end()) found = totals.insert(found, { s.name, s.device, 0, 0, 0 });
+            auto ms = (s.end - s.begin) * 1e-6;
+            found->sum += ms;
+            found->max = std::max(found->max, ms);
+            found->n += 1;
+        }
+        output << "frame " << this->frame << ':';
+        for (auto const& t : totals) {
+            output << ' ' << (t.device ? "[dev]" : "") << t.name
+                   << ' ' << t.sum / t.n << "ms(max " << t.max << ')';
+        }
+        output << std::endl;
+    }
+
+    // Chrome trace event format, for Perfetto or chrome://tracing.
+    bool write() const noexcept {
+        if (!this->enabled()) return true;
+        std::ofstream output(this->path);
+        if (!output) {
+            std::cerr << "Cannot open " << this->path << "..." << std::endl;
+            return false;
+        }
+        output << std::fixed << std::setprecision(3)
+               << "{\"traceEvents\":[\n"
+               << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"host\"}},\n"
+               << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"device\"}}";
+        for (size_t i = this->recorded - std::min(this->recorded, capacity); i < this->recorded; ++i) {
+            auto const& s = this->ring[i % capacity];
+            output << ",\n{\"name\":\"" << s.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (s.device ? 2 : 1)
+                   << ",\"ts\":" << s.begin / 1000.0 << ",\"dur\":" << (s.end - s.begin) / 1000.0
+                   << ",\"args\":{\"frame\":" << s.frame << "}}";
+        }
+        output << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+        return bool(output);
+    }
+};